@@ -0,0 +1,261 @@
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "model/IndexedFaceSet.h"
+#include "tetmesh/tetmesh.h"
+#include "tetmesh/TetMeshFactory.h"
+
+// Microbenchmarks for the TetMesh primitives on neighborhoods taken from real meshes.
+//
+//   idsc-primitive-bench [-m assets/models/sphere.obj,assets/models/teapot_body.obj] [-n samples]
+//
+// Samples are drawn from the interface and its one-ring, where evolve() spends its time.
+// Allocations are counted by replacing the global operator new in this program.
+
+#define DEFAULT_SAMPLES 2000
+#define DEFAULT_MODELS "assets/models/sphere.obj,assets/models/teapot_body.obj"
+
+static unsigned long long num_allocations = 0;
+
+void * operator new(size_t size) {
+    num_allocations++;
+    void * p = malloc(size ? size : 1);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void * p) noexcept {
+    free(p);
+}
+
+void * operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void * p) noexcept {
+    free(p);
+}
+
+struct BenchResult {
+    BenchResult() : seconds(0), allocations(0), ops(0) { }
+    double seconds;
+    unsigned long long allocations;
+    unsigned long long ops;
+};
+
+class PrimitiveBench {
+    public:
+        PrimitiveBench(TetMesh & tet_mesh, unsigned int num_samples);
+
+        BenchResult bench_get_vertex_status();
+        BenchResult bench_get_distance_movable();
+        BenchResult bench_get_tets_from_face();
+        BenchResult bench_is_on_domain_boundary();
+        BenchResult bench_intersect_with();
+        BenchResult bench_split_edge();
+        BenchResult bench_collapse_edge();
+
+    private:
+        TetMesh & tet_mesh;
+        std::vector<unsigned int> sample_vertices;
+        std::vector<Edge> sample_edges;
+        std::vector<Face> sample_faces;
+        std::vector<REAL> sample_velocities; // 3 REALs per sample vertex
+};
+
+// Runs `body` over the first `num_ops` samples once untimed to warm caches, then timed
+#define TIMED_LOOP(bench_result, num_ops, body) \
+    for (unsigned int i = 0; i < (num_ops); i++) { body; } \
+    { \
+        unsigned long long allocations_before = num_allocations; \
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now(); \
+        for (unsigned int i = 0; i < (num_ops); i++) { body; } \
+        bench_result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); \
+        bench_result.allocations = num_allocations - allocations_before; \
+        bench_result.ops = (num_ops); \
+    }
+
+PrimitiveBench::PrimitiveBench(TetMesh & tet_mesh, unsigned int num_samples) : tet_mesh(tet_mesh) {
+    unsigned int num_vertices = tet_mesh.vertices.size() / 3;
+    std::vector<bool> picked(num_vertices, false);
+
+    // interface vertices first, then their neighbors, until we have enough
+    for (unsigned int v = 0; v < num_vertices && sample_vertices.size() < num_samples; v++) {
+        if (tet_mesh.is_vertex_alive(v) && tet_mesh.get_vertex_status(v) == INTERFACE) {
+            sample_vertices.push_back(v);
+            picked[v] = true;
+        }
+    }
+    for (unsigned int i = 0; i < sample_vertices.size() && sample_vertices.size() < num_samples; i++) {
+        GeometrySet<unsigned int> star = tet_mesh.vertex_tet_map[sample_vertices[i]];
+        for (auto it = star.begin(); it != star.end(); it++) {
+            for (unsigned int j = 0; j < 4; j++) {
+                unsigned int v = tet_mesh.tets[*it * 4 + j];
+                if (!picked[v] && sample_vertices.size() < num_samples) {
+                    sample_vertices.push_back(v);
+                    picked[v] = true;
+                }
+            }
+        }
+    }
+
+    unsigned int seed = 12345;
+    for (unsigned int i = 0; i < sample_vertices.size(); i++) {
+        GeometrySet<unsigned int> star = tet_mesh.vertex_tet_map[sample_vertices[i]];
+        if (star.size() == 0) {
+            continue;
+        }
+        unsigned int t = star.getItems()[i % star.size()];
+        unsigned int a = tet_mesh.tets[t * 4 + i % 4];
+        unsigned int b = tet_mesh.tets[t * 4 + (i + 1) % 4];
+        sample_edges.push_back(Edge(a, b));
+        sample_faces.push_back(tet_mesh.get_opposite_face(t, tet_mesh.tets[t * 4 + (i + 2) % 4]));
+
+        REAL velocity[3];
+        for (unsigned int k = 0; k < 3; k++) {
+            seed = seed * 1103515245 + 12345;
+            velocity[k] = ((seed >> 16) & 0x7fff) / 16384.0 - 1.0;
+        }
+        REAL length = sqrt(velocity[0] * velocity[0] + velocity[1] * velocity[1] + velocity[2] * velocity[2]);
+        for (unsigned int k = 0; k < 3; k++) {
+            sample_velocities.push_back(length > 0 ? velocity[k] / length : 1);
+        }
+    }
+}
+
+BenchResult PrimitiveBench::bench_get_vertex_status() {
+    BenchResult result;
+    volatile int sink = 0;
+    TIMED_LOOP(result, sample_vertices.size(), sink += tet_mesh.get_vertex_status(sample_vertices[i]));
+    return result;
+}
+
+BenchResult PrimitiveBench::bench_get_distance_movable() {
+    BenchResult result;
+    volatile REAL sink = 0;
+    unsigned int num_velocities = sample_velocities.size() / 3;
+    if (num_velocities == 0) {
+        return result;
+    }
+    TIMED_LOOP(result, sample_vertices.size(),
+        sink += tet_mesh.get_distance_movable(sample_vertices[i], &sample_velocities[(i % num_velocities) * 3]).distance);
+    return result;
+}
+
+BenchResult PrimitiveBench::bench_get_tets_from_face() {
+    BenchResult result;
+    volatile unsigned int sink = 0;
+    TIMED_LOOP(result, sample_faces.size(), sink += tet_mesh.get_tets_from_face(sample_faces[i]).size());
+    return result;
+}
+
+BenchResult PrimitiveBench::bench_is_on_domain_boundary() {
+    BenchResult result;
+    volatile int sink = 0;
+    TIMED_LOOP(result, sample_vertices.size(), sink += tet_mesh.is_on_domain_boundary(sample_vertices[i]));
+    return result;
+}
+
+BenchResult PrimitiveBench::bench_intersect_with() {
+    BenchResult result;
+    volatile unsigned int sink = 0;
+    TIMED_LOOP(result, sample_edges.size(),
+        sink += tet_mesh.vertex_tet_map[sample_edges[i].getV1()]
+            .intersectWith(tet_mesh.vertex_tet_map[sample_edges[i].getV2()]).size());
+    return result;
+}
+
+// Mutating primitives run on a private copy and are timed one call at a time, so that
+// edges invalidated by earlier operations can be skipped outside the timed region.
+BenchResult PrimitiveBench::bench_split_edge() {
+    BenchResult result;
+    TetMesh scratch(tet_mesh);
+    for (unsigned int i = 0; i < sample_edges.size(); i++) {
+        Edge e = sample_edges[i];
+        if (scratch.vertex_tet_map[e.getV1()].intersectWith(scratch.vertex_tet_map[e.getV2()]).size() == 0) {
+            continue;
+        }
+        unsigned long long allocations_before = num_allocations;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        scratch.split_edge(e);
+        result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.allocations += num_allocations - allocations_before;
+        result.ops++;
+    }
+    return result;
+}
+
+BenchResult PrimitiveBench::bench_collapse_edge() {
+    BenchResult result;
+    TetMesh scratch(tet_mesh);
+    for (unsigned int i = 0; i < sample_edges.size(); i++) {
+        Edge e = sample_edges[i];
+        unsigned int v1 = e.getV1();
+        unsigned int v2 = e.getV2();
+        if (!scratch.is_vertex_alive(v1) || !scratch.is_vertex_alive(v2) ||
+            !scratch.is_movable(v1) || !scratch.is_movable(v2) ||
+            scratch.vertex_tet_map[v1].intersectWith(scratch.vertex_tet_map[v2]).size() == 0) {
+            continue;
+        }
+        unsigned long long allocations_before = num_allocations;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        scratch.collapse_edge(e);
+        result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.allocations += num_allocations - allocations_before;
+        result.ops++;
+    }
+    return result;
+}
+
+static void report(const std::string & model, const char * name, BenchResult result) {
+    double ops = result.ops ? (double) result.ops : 1.0;
+    printf("%-30s %-24s %12.1f %12.2f %10llu\n", model.c_str(), name,
+           result.seconds * 1e9 / ops, result.allocations / ops, result.ops);
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int num_samples = DEFAULT_SAMPLES;
+    std::string models = DEFAULT_MODELS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            num_samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            models = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-m model.obj,...] [-n samples]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("%-30s %-24s %12s %12s %10s\n", "mesh", "primitive", "ns/op", "allocs/op", "ops");
+    std::istringstream model_list(models);
+    for (std::string model; getline(model_list, model, ',');) {
+        IndexedFaceSet * mesh = IndexedFaceSet::load_from_obj(model);
+        TetMesh * tet_mesh = TetMeshFactory::from_indexed_face_set(*mesh);
+        delete mesh;
+        if (tet_mesh == NULL) {
+            fprintf(stderr, "could not mesh %s, skipped\n", model.c_str());
+            continue;
+        }
+
+        PrimitiveBench bench(*tet_mesh, num_samples);
+        report(model, "get_vertex_status", bench.bench_get_vertex_status());
+        report(model, "get_distance_movable", bench.bench_get_distance_movable());
+        report(model, "get_tets_from_face", bench.bench_get_tets_from_face());
+        report(model, "is_on_domain_boundary", bench.bench_is_on_domain_boundary());
+        report(model, "GeometrySet::intersectWith", bench.bench_intersect_with());
+        report(model, "split_edge", bench.bench_split_edge());
+        report(model, "collapse_edge", bench.bench_collapse_edge());
+        delete tet_mesh;
+    }
+    return 0;
+}
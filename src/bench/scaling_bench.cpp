@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "model/IndexedFaceSet.h"
+#include "tetmesh/tetmesh.h"
+#include "tetmesh/TetMeshFactory.h"
+#include "tetmesh/Scenario.h"
+
+// Meshes generated spheres and tori at increasing subdivision levels, evolves the
+// standard stretch deformation (Scenario 7) on each and writes time and memory per tet
+// as CSV, plus an optional gnuplot script to plot them.
+//
+//   idsc-scaling-bench [-s sphere,torus] [-l 1,2,3,4,5,6] [-t 1,2,4] [-o scaling.csv] [-p scaling.gp]
+//                      [--no-reorder] [--no-grading] [--margin m] [--faces n]
+//
+// evolve() itself is serial; with -t N the same mesh is evolved on N independent copies at
+// once, which shows how per-tet cost degrades once several engines share memory bandwidth.
+// Meshing always runs on one thread since tetgen keeps global state.
+//
+// idsc-scaling-bench-float is the same program built against single-precision coordinate
+// storage; the coord_bytes column tells the two apart when their CSVs are concatenated.
+
+#define STRETCH_SCENARIO 7
+#define SPHERE_RADIUS 1.0f
+#define TORUS_MAJOR_RADIUS 1.5f
+#define TORUS_MINOR_RADIUS 0.5f
+
+static std::vector<std::string> split_list(const char * list) {
+    std::vector<std::string> items;
+    std::istringstream stream(list);
+    for (std::string item; getline(stream, item, ',');) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static TetMesh * build(const std::string & shape, int level, unsigned int & num_faces) {
+    IndexedFaceSet * surface;
+    if (shape == "torus") {
+        surface = IndexedFaceSet::create_torus(level, TORUS_MAJOR_RADIUS, TORUS_MINOR_RADIUS);
+    } else {
+        surface = IndexedFaceSet::create_sphere(level, SPHERE_RADIUS);
+    }
+    TetMesh * tet_mesh = TetMeshFactory::from_indexed_face_set(*surface);
+    num_faces = surface->get_num_faces(); // after cleaning and any decimation
+    delete surface;
+    return tet_mesh;
+}
+
+static void write_plot_script(const char * plot_file, const char * csv_file) {
+    std::ofstream plot(plot_file);
+    plot << "# gnuplot " << plot_file << "\n"
+         << "set datafile separator ','\n"
+         << "set key autotitle columnhead\n"
+         << "set logscale x\n"
+         << "set xlabel 'tets'\n"
+         << "set terminal pngcairo size 1200,500\n"
+         << "set output 'scaling.png'\n"
+         << "set multiplot layout 1,2\n"
+         << "set ylabel 'evolve us / tet'\n"
+         << "set cblabel 'threads'\n"
+         << "plot '" << csv_file << "' using 4:8:3 with points pointtype 7 palette title 'evolve'\n"
+         << "set ylabel 'bytes / tet'\n"
+         << "plot '" << csv_file << "' using 4:9 with points title 'mesh arrays'\n"
+         << "unset multiplot\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> shapes = split_list("sphere,torus");
+    std::vector<std::string> levels = split_list("1,2,3,4,5,6");
+    std::vector<std::string> thread_counts = split_list("1");
+    const char * csv_file = "scaling.csv";
+    const char * plot_file = NULL;
+    MeshingOptions meshing_options;
+    meshing_options.use_cache = false; // factory_s has to time tetgen, not a cache hit
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            shapes = split_list(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            levels = split_list(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            thread_counts = split_list(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            csv_file = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            plot_file = argv[++i];
+        } else if (strcmp(argv[i], "--no-grading") == 0) {
+            meshing_options.grading = false;
+        } else if (strcmp(argv[i], "--margin") == 0 && i + 1 < argc) {
+            meshing_options.domain_margin = atof(argv[++i]);
+            if (!(meshing_options.domain_margin > 0)) {
+                fprintf(stderr, "--margin has to be positive\n");
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--faces") == 0 && i + 1 < argc) {
+            meshing_options.face_budget = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-reorder") == 0) {
+            meshing_options.reorder = false;
+        } else {
+            fprintf(stderr, "usage: %s [-s sphere,torus] [-l levels] [-t threads] [-o out.csv] [-p out.gp] [--no-reorder] [--no-grading] [--margin m] [--faces n]\n", argv[0]);
+            return 2;
+        }
+    }
+    TetMeshFactory::set_default_options(meshing_options);
+
+    std::ofstream csv(csv_file);
+    csv << "shape,level,threads,tets,surface_faces,factory_s,evolve_s,evolve_us_per_tet,bytes_per_tet,peak_rss_kb,coord_bytes" << std::endl;
+
+    // the engine reports progress on stdout; keep it out of the way of large runs
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+        fprintf(stderr, "could not silence stdout\n");
+    }
+
+    for (unsigned int s = 0; s < shapes.size(); s++) {
+        for (unsigned int l = 0; l < levels.size(); l++) {
+            int level = atoi(levels[l].c_str());
+            unsigned int num_faces;
+            fprintf(stderr, "meshing %s level %d...\n", shapes[s].c_str(), level);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            TetMesh * tet_mesh = build(shapes[s], level, num_faces);
+            double factory = seconds_since(start);
+            if (tet_mesh == NULL) {
+                fprintf(stderr, "  could not mesh %s level %d, skipped\n", shapes[s].c_str(), level);
+                continue;
+            }
+            unsigned int num_tets = tet_mesh->get_num_tets();
+            double bytes_per_tet = (double) tet_mesh->get_memory_usage() / num_tets;
+
+            for (unsigned int t = 0; t < thread_counts.size(); t++) {
+                int num_threads = std::max(1, atoi(thread_counts[t].c_str()));
+                std::vector<TetMesh> copies(num_threads, *tet_mesh);
+                std::vector<std::thread> workers;
+
+                fprintf(stderr, "  evolving %u tets on %d thread(s)...\n", num_tets, num_threads);
+                start = std::chrono::steady_clock::now();
+                for (int w = 0; w < num_threads; w++) {
+                    TetMesh * copy = &copies[w];
+                    workers.push_back(std::thread([copy] { Scenario::evolve(*copy, STRETCH_SCENARIO); }));
+                }
+                for (int w = 0; w < num_threads; w++) {
+                    workers[w].join();
+                }
+                double evolve = seconds_since(start);
+
+                struct rusage usage;
+                getrusage(RUSAGE_SELF, &usage);
+                csv << shapes[s] << "," << level << "," << num_threads << "," << num_tets << ","
+                    << num_faces << "," << factory << "," << evolve << ","
+                    << evolve * 1e6 / num_tets << "," << bytes_per_tet << ","
+                    << usage.ru_maxrss << "," << sizeof(coord_t) << std::endl;
+            }
+            delete tet_mesh;
+        }
+    }
+
+    if (plot_file != NULL) {
+        write_plot_script(plot_file, csv_file);
+    }
+    return 0;
+}
@@ -0,0 +1,336 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "tetmesh/tetmesh.h"
+#include "tetmesh/Scenario.h"
+#include "tetmesh/TetMeshFactory.h"
+
+// Runs the Scenario cases headlessly and reports per-phase timings and the EvolveStats
+// counters as JSON, or compares two such result files and flags regressions.
+//
+//   idsc-bench [-r repetitions] [-s 1,5,7] [-o results.json] [-p]
+//              [--no-reorder] [--no-grading] [--margin m] [--faces n]
+//   idsc-bench --compare baseline.json candidate.json [-t threshold]
+//
+// Each scenario runs in a forked child so that peak RSS is per scenario and the engine's
+// progress output can be silenced without touching the results pipe. With -p the hardware
+// counters of advect and retesselate (summed over all repetitions) are added to the output.
+// --no-reorder keeps tetgen's element order, to measure what TetMesh::reorder buys;
+// --no-grading and --margin change how the domain around the surface is meshed, and --faces
+// decimates the input surface to that many faces first (MeshingOptions).
+
+#define DEFAULT_REPETITIONS 3
+#define DEFAULT_THRESHOLD 0.10
+
+// Times are medians over the repetitions; counts come from the last repetition
+// (they are deterministic for a given scenario). Phase times and counts read zero when
+// the engine is built with DSC_NO_STATS.
+static const char * TIME_METRICS[] = {
+    "factory_s", "evolve_s", "total_s"
+};
+static const int NUM_TIME_METRICS = 3;
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    if (n == 0) {
+        return 0;
+    }
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs one scenario `repetitions` times and returns its JSON object, or "" if it can't be built
+static std::string run_scenario(int scenario, int repetitions, bool hardware_counters) {
+    std::vector<double> times[NUM_TIME_METRICS];
+    std::vector<double> phase_times[NUM_PHASES];
+    EvolveStats stats;
+    EvolveStats hardware_stats;
+    unsigned int num_tets = 0;
+
+    for (int r = 0; r < repetitions; r++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        TetMesh * tet_mesh = Scenario::create(scenario);
+        if (tet_mesh == NULL) {
+            return "";
+        }
+        double factory = seconds_since(start);
+
+        tet_mesh->set_hardware_counters(hardware_counters);
+        std::chrono::steady_clock::time_point evolve_start = std::chrono::steady_clock::now();
+        Scenario::evolve(*tet_mesh, scenario);
+        double evolve = seconds_since(evolve_start);
+
+        stats = tet_mesh->get_stats();
+        hardware_stats.add(stats);
+        num_tets = tet_mesh->get_num_tets();
+        delete tet_mesh;
+
+        times[0].push_back(factory);
+        times[1].push_back(evolve);
+        times[2].push_back(seconds_since(start));
+        for (int p = 0; p < NUM_PHASES; p++) {
+            phase_times[p].push_back(stats.phase_seconds[p]);
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::ostringstream out;
+    out.precision(9);
+    out << "    {\"id\": " << scenario << ", \"name\": \"" << Scenario::get_name(scenario) << "\"";
+    for (int m = 0; m < NUM_TIME_METRICS; m++) {
+        out << ", \"" << TIME_METRICS[m] << "\": " << median(times[m]);
+    }
+    for (int p = 0; p < NUM_PHASES; p++) {
+        out << ", \"" << EvolveStats::get_phase_name(p) << "_s\": " << median(phase_times[p]);
+    }
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        out << ", \"" << EvolveStats::get_counter_name(c) << "\": " << stats.counters[c];
+    }
+    out << ", \"final_tets\": " << num_tets
+        << ", \"peak_rss_kb\": " << usage.ru_maxrss;
+    std::string hardware_fields;
+    hardware_stats.append_hardware_json(hardware_fields);
+    out << hardware_fields << "}";
+    return out.str();
+}
+
+// Forks so the child's peak RSS and stdout are its own; the JSON comes back over a pipe
+static std::string run_scenario_isolated(int scenario, int repetitions, bool hardware_counters) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return "";
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        if (freopen("/dev/null", "w", stdout) == NULL) {
+            _exit(2);
+        }
+        std::string result = run_scenario(scenario, repetitions, hardware_counters);
+        ssize_t written = write(fds[1], result.c_str(), result.size());
+        close(fds[1]);
+        _exit(!result.empty() && written == (ssize_t) result.size() ? 0 : 1);
+    }
+    close(fds[1]);
+
+    std::string result;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        result.append(buffer, n);
+    }
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "scenario %d (%s) failed\n", scenario, Scenario::get_name(scenario));
+        return "";
+    }
+    return result;
+}
+
+// Minimal reader for the files this program writes: one flat object per scenario,
+// keyed by scenario name, holding its numeric fields.
+typedef std::map<std::string, std::map<std::string, double> > results_t;
+
+static bool load_results(const char * file_name, results_t & results) {
+    std::ifstream input(file_name);
+    if (!input) {
+        fprintf(stderr, "could not open %s\n", file_name);
+        return false;
+    }
+    for (std::string line; getline(input, line);) {
+        size_t open = line.find('{');
+        size_t close = line.rfind('}');
+        if (open == std::string::npos || close == std::string::npos || line.find("\"name\"") == std::string::npos) {
+            continue;
+        }
+        std::string name;
+        std::map<std::string, double> fields;
+        std::string body = line.substr(open + 1, close - open - 1);
+        std::istringstream pairs(body);
+        for (std::string pair; getline(pairs, pair, ',');) {
+            size_t colon = pair.find(':');
+            size_t key_start = pair.find('"');
+            size_t key_end = pair.find('"', key_start + 1);
+            if (colon == std::string::npos || key_start == std::string::npos || key_end == std::string::npos) {
+                continue;
+            }
+            std::string key = pair.substr(key_start + 1, key_end - key_start - 1);
+            std::string value = pair.substr(colon + 1);
+            size_t quote = value.find('"');
+            if (quote != std::string::npos) {
+                name = value.substr(quote + 1, value.rfind('"') - quote - 1);
+            } else {
+                fields[key] = atof(value.c_str());
+            }
+        }
+        results[name] = fields;
+    }
+    return true;
+}
+
+static int compare(const char * baseline_file, const char * candidate_file, double threshold) {
+    results_t baseline, candidate;
+    if (!load_results(baseline_file, baseline) || !load_results(candidate_file, candidate)) {
+        return 2;
+    }
+
+    static const char * compared[] = {
+        "factory_s", "advect_s", "retesselate_s", "evolve_s", "total_s",
+        "iterations", "failed_collapses", "peak_rss_kb",
+        "advect_instructions", "advect_llc_misses", "retesselate_instructions", "retesselate_llc_misses"
+    };
+    int regressions = 0;
+    printf("%-18s %-16s %12s %12s %8s\n", "scenario", "metric", "baseline", "candidate", "change");
+    for (results_t::iterator it = candidate.begin(); it != candidate.end(); ++it) {
+        if (baseline.find(it->first) == baseline.end()) {
+            printf("%-18s missing from %s\n", it->first.c_str(), baseline_file);
+        }
+    }
+    for (results_t::iterator it = baseline.begin(); it != baseline.end(); ++it) {
+        results_t::iterator match = candidate.find(it->first);
+        if (match == candidate.end()) {
+            printf("%-18s missing from %s\n", it->first.c_str(), candidate_file);
+            continue;
+        }
+        const std::map<std::string, double> & old_fields = it->second;
+        const std::map<std::string, double> & new_fields = match->second;
+        for (unsigned int m = 0; m < sizeof(compared) / sizeof(compared[0]); m++) {
+            std::map<std::string, double>::const_iterator old_field = old_fields.find(compared[m]);
+            std::map<std::string, double>::const_iterator new_field = new_fields.find(compared[m]);
+            if (old_field == old_fields.end() && new_field == new_fields.end()) {
+                continue; // hardware counters, say, recorded by neither run
+            }
+            if (old_field == old_fields.end() || new_field == new_fields.end()) {
+                printf("%-18s %-16s missing from %s\n", it->first.c_str(), compared[m],
+                       old_field == old_fields.end() ? baseline_file : candidate_file);
+                continue;
+            }
+            double old_value = old_field->second;
+            double new_value = new_field->second;
+            // a rise from 0 (failed_collapses, for one) has no relative change but is still a regression
+            bool regressed;
+            char change[16];
+            if (old_value > 0) {
+                double relative = (new_value - old_value) / old_value;
+                regressed = relative > threshold;
+                snprintf(change, sizeof(change), "%+7.1f%%", relative * 100);
+            } else {
+                regressed = new_value > old_value;
+                snprintf(change, sizeof(change), "%8s", regressed ? "from 0" : "");
+            }
+            regressions += regressed;
+            printf("%-18s %-16s %12.6g %12.6g %s%s\n", it->first.c_str(), compared[m],
+                   old_value, new_value, change, regressed ? "  REGRESSION" : "");
+        }
+    }
+    printf("%d regression(s) above %.1f%%\n", regressions, threshold * 100);
+    return regressions > 0 ? 1 : 0;
+}
+
+static void print_usage(const char * program) {
+    fprintf(stderr, "usage: %s [-r repetitions] [-s 1,2,...] [-o results.json] [-p] [--no-reorder] [--no-grading] [--margin m] [--faces n]\n", program);
+    fprintf(stderr, "       %s --compare baseline.json candidate.json [-t threshold]\n", program);
+}
+
+int main(int argc, char* argv[]) {
+    int repetitions = DEFAULT_REPETITIONS;
+    double threshold = DEFAULT_THRESHOLD;
+    const char * output_file = NULL;
+    bool hardware_counters = false;
+    const char * compare_files[2] = { NULL, NULL };
+    std::vector<int> scenarios;
+    MeshingOptions meshing_options;
+    meshing_options.use_cache = false; // factory_s has to time tetgen, not a cache hit
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            repetitions = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            std::istringstream list(argv[++i]);
+            for (std::string id; getline(list, id, ',');) {
+                scenarios.push_back(atoi(id.c_str()));
+            }
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0) {
+            hardware_counters = true;
+        } else if (strcmp(argv[i], "--no-grading") == 0) {
+            meshing_options.grading = false;
+        } else if (strcmp(argv[i], "--margin") == 0 && i + 1 < argc) {
+            meshing_options.domain_margin = atof(argv[++i]);
+            if (!(meshing_options.domain_margin > 0)) {
+                fprintf(stderr, "--margin has to be positive\n");
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--faces") == 0 && i + 1 < argc) {
+            meshing_options.face_budget = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-reorder") == 0) {
+            meshing_options.reorder = false;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 2 < argc) {
+            compare_files[0] = argv[++i];
+            compare_files[1] = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+    TetMeshFactory::set_default_options(meshing_options);
+
+    if (compare_files[0] != NULL) {
+        return compare(compare_files[0], compare_files[1], threshold);
+    }
+
+    if (scenarios.empty()) {
+        for (int s = 1; s <= Scenario::NUM_SCENARIOS; s++) {
+            scenarios.push_back(s);
+        }
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"repetitions\": " << repetitions << ",\n  \"scenarios\": [\n";
+    bool first = true;
+    int failures = 0;
+    for (unsigned int i = 0; i < scenarios.size(); i++) {
+        fprintf(stderr, "running %s (%d repetitions)...\n", Scenario::get_name(scenarios[i]), repetitions);
+        std::string result = run_scenario_isolated(scenarios[i], repetitions, hardware_counters);
+        if (result.empty()) {
+            failures++;
+            continue;
+        }
+        json << (first ? "" : ",\n") << result;
+        first = false;
+    }
+    json << "\n  ]\n}\n";
+
+    if (output_file != NULL) {
+        std::ofstream output(output_file);
+        output << json.str();
+    } else {
+        printf("%s", json.str().c_str());
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "model/IndexedFaceSet.h"
+#include "tetmesh/tetmesh.h"
+#include "tetmesh/TetMeshFactory.h"
+#include "tetmesh/Scenario.h"
+#include "util/Trace.h"
+
+// Headless front end: builds a scenario's tet mesh, evolves it and writes the result
+// without creating a window or GL context.
+
+static void print_usage(const char * program) {
+    fprintf(stderr, "usage: %s [scenario] [-i input.obj] [-d faces] [-e error] [-o output_prefix] [-v] [-p] [-t trace.json]\n", program);
+    fprintf(stderr, "  scenario       1-%d, see tetmesh/Scenario.h (default 1)\n", Scenario::NUM_SCENARIOS);
+    fprintf(stderr, "  -i input.obj   mesh this surface instead of the scenario's own input\n");
+    fprintf(stderr, "  -d faces       decimate the input surface to this many faces before meshing\n");
+    fprintf(stderr, "  -e error       ...or until it would move by this fraction of its bounding box diagonal\n");
+    fprintf(stderr, "  -o prefix      write <prefix>.node and <prefix>.ele (default output/<scenario name>)\n");
+    fprintf(stderr, "  -v             print the EvolveStats of every evolve call to stderr\n");
+    fprintf(stderr, "  -p             add hardware counters (IPC, LLC and branch misses) to -v output\n");
+    fprintf(stderr, "  -t trace.json  record a Chrome trace-event timeline (same as IDSC_TRACE=trace.json)\n");
+}
+
+int main(int argc, char* argv[]) {
+    int scenario = 1;
+    const char * input_file = NULL;
+    std::string output_prefix;
+    bool verbose = false;
+    bool hardware_counters = false;
+    MeshingOptions meshing_options;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            input_file = argv[++i];
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            meshing_options.face_budget = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            meshing_options.max_decimation_error = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_prefix = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            hardware_counters = true;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            Trace::start(argv[++i]);
+        } else if (argv[i][0] >= '0' && argv[i][0] <= '9') {
+            scenario = atoi(argv[i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    TetMeshFactory::set_default_options(meshing_options);
+    if (output_prefix.empty()) {
+        output_prefix = std::string("output/") + Scenario::get_name(scenario);
+    }
+
+    printf("Generating tet mesh...\n");
+    TetMesh * tet_mesh;
+    if (input_file != NULL) {
+        IndexedFaceSet * mesh = IndexedFaceSet::load_from_obj(input_file);
+        tet_mesh = TetMeshFactory::from_indexed_face_set(*mesh);
+        delete mesh;
+    } else {
+        tet_mesh = Scenario::create(scenario);
+    }
+    if (tet_mesh == NULL) {
+        return 1;
+    }
+
+    if (verbose) {
+        tet_mesh->set_stats_output(stderr);
+    }
+    tet_mesh->set_hardware_counters(hardware_counters);
+    Scenario::evolve(*tet_mesh, scenario);
+    if (verbose) {
+        fprintf(stderr, "total %s\n", tet_mesh->get_stats().to_json().c_str());
+    }
+
+    printf("Writing %s.node/.ele...\n", output_prefix.c_str());
+    bool written = tet_mesh->write_to_files(output_prefix);
+    delete tet_mesh;
+
+    return written ? 0 : 1;
+}
@@ -1,9 +1,22 @@
 
 #include "IndexedFaceSet.h"
 
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <queue>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "util/vec.h"
+
 tetgenio * IndexedFaceSet::to_tetgenio(IndexedFaceSet & ifs) {
     tetgenio * out = new tetgenio();
 
@@ -142,6 +155,909 @@ IndexedFaceSet * IndexedFaceSet::load_from_obj(std::string file_name) {
     return new IndexedFaceSet(vertices.size() / 3, vertex_buffer, indices.size(), index_buffer);
 }
 
+static IndexedFaceSet * from_vectors(std::vector<float> & vertices, std::vector<int> & indices) {
+    float * vertex_buffer = (float *) malloc(vertices.size() * sizeof(float));
+    std::copy(vertices.begin(), vertices.end(), vertex_buffer);
+    int * index_buffer = (int *) malloc(indices.size() * sizeof(int));
+    std::copy(indices.begin(), indices.end(), index_buffer);
+    return new IndexedFaceSet(vertices.size() / 3, vertex_buffer, indices.size(), index_buffer);
+}
+
+// Returns the index of the vertex halfway between a and b, projected onto the sphere
+static int sphere_midpoint(std::vector<float> & vertices, std::map<std::pair<int, int>, int> & cache,
+                           int a, int b, float radius) {
+    std::pair<int, int> key(std::min(a, b), std::max(a, b));
+    std::map<std::pair<int, int>, int>::iterator it = cache.find(key);
+    if (it != cache.end()) {
+        return it->second;
+    }
+    float m[3];
+    for (int i = 0; i < 3; i++) {
+        m[i] = (vertices[a * 3 + i] + vertices[b * 3 + i]) / 2;
+    }
+    float length = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+    int index = vertices.size() / 3;
+    for (int i = 0; i < 3; i++) {
+        vertices.push_back(m[i] * radius / length);
+    }
+    cache[key] = index;
+    return index;
+}
+
+// Subdivided icosahedron centered at the origin
+IndexedFaceSet * IndexedFaceSet::create_sphere(int subdivisions, float radius) {
+    const float t = (1.0 + sqrt(5.0)) / 2;
+    const float ico_vertices[] = {
+        -1, t, 0,   1, t, 0,   -1, -t, 0,   1, -t, 0,
+        0, -1, t,   0, 1, t,   0, -1, -t,   0, 1, -t,
+        t, 0, -1,   t, 0, 1,   -t, 0, -1,   -t, 0, 1
+    };
+    const int ico_faces[] = {
+        0, 11, 5,   0, 5, 1,   0, 1, 7,   0, 7, 10,   0, 10, 11,
+        1, 5, 9,   5, 11, 4,   11, 10, 2,   10, 7, 6,   7, 1, 8,
+        3, 9, 4,   3, 4, 2,   3, 2, 6,   3, 6, 8,   3, 8, 9,
+        4, 9, 5,   2, 4, 11,   6, 2, 10,   8, 6, 7,   9, 8, 1
+    };
+
+    std::vector<float> vertices;
+    float length = sqrt(1 + t * t);
+    for (int i = 0; i < 12 * 3; i++) {
+        vertices.push_back(ico_vertices[i] * radius / length);
+    }
+    std::vector<int> indices(ico_faces, ico_faces + 20 * 3);
+
+    for (int level = 0; level < subdivisions; level++) {
+        std::map<std::pair<int, int>, int> cache;
+        std::vector<int> refined;
+        refined.reserve(indices.size() * 4);
+        for (unsigned int f = 0; f < indices.size(); f += 3) {
+            int a = indices[f];
+            int b = indices[f + 1];
+            int c = indices[f + 2];
+            int ab = sphere_midpoint(vertices, cache, a, b, radius);
+            int bc = sphere_midpoint(vertices, cache, b, c, radius);
+            int ca = sphere_midpoint(vertices, cache, c, a, radius);
+            int faces[] = {
+                a, ab, ca,   b, bc, ab,   c, ca, bc,   ab, bc, ca
+            };
+            refined.insert(refined.end(), faces, faces + 12);
+        }
+        indices.swap(refined);
+    }
+    return from_vectors(vertices, indices);
+}
+
+// Torus around the z axis, centered at the origin
+IndexedFaceSet * IndexedFaceSet::create_torus(int subdivisions, float major_radius, float minor_radius) {
+    const float pi = 3.14159265358979f;
+    int num_major = 8 << subdivisions;
+    int num_minor = 4 << subdivisions;
+
+    std::vector<float> vertices;
+    std::vector<int> indices;
+    vertices.reserve(num_major * num_minor * 3);
+    indices.reserve(num_major * num_minor * 6);
+    for (int i = 0; i < num_major; i++) {
+        float u = 2 * pi * i / num_major;
+        for (int j = 0; j < num_minor; j++) {
+            float v = 2 * pi * j / num_minor;
+            float r = major_radius + minor_radius * cos(v);
+            vertices.push_back(r * cos(u));
+            vertices.push_back(r * sin(u));
+            vertices.push_back(minor_radius * sin(v));
+        }
+    }
+    for (int i = 0; i < num_major; i++) {
+        int next_i = (i + 1) % num_major;
+        for (int j = 0; j < num_minor; j++) {
+            int next_j = (j + 1) % num_minor;
+            int a = i * num_minor + j;
+            int b = next_i * num_minor + j;
+            int c = next_i * num_minor + next_j;
+            int d = i * num_minor + next_j;
+            int faces[] = {
+                a, b, c,   a, c, d
+            };
+            indices.insert(indices.end(), faces, faces + 6);
+        }
+    }
+    return from_vectors(vertices, indices);
+}
+
+// Compacts the faces in place, then the vertices they still use, keeping both orders; returns
+// how many vertices were dropped
+int IndexedFaceSet::remove_faces(const std::vector<bool> & keep) {
+    int num_kept = 0;
+    std::vector<int> new_index(num_vertices, -1);
+    for (int f = 0; f < num_indices / 3; f++) {
+        if (!keep[f]) {
+            continue;
+        }
+        for (int j = 0; j < 3; j++) {
+            indices[num_kept * 3 + j] = indices[f * 3 + j];
+            new_index[indices[f * 3 + j]] = 0;
+        }
+        num_kept++;
+    }
+    num_indices = num_kept * 3;
+    int num_used = 0;
+    for (int v = 0; v < num_vertices; v++) {
+        if (new_index[v] == -1) {
+            continue;
+        }
+        new_index[v] = num_used;
+        for (int k = 0; k < 3; k++) {
+            vertices[num_used * 3 + k] = vertices[v * 3 + k];
+        }
+        num_used++;
+    }
+    for (int i = 0; i < num_indices; i++) {
+        indices[i] = new_index[indices[i]];
+    }
+    int num_dropped = num_vertices - num_used;
+    num_vertices = num_used;
+    return num_dropped;
+}
+
+// Cell coordinates are packed 21 bits per axis, so the grid is at most this many cells wide
+#define WELD_GRID_LIMIT (1 << 21)
+
+int IndexedFaceSet::clean(float relative_tolerance) {
+    if (num_vertices == 0) {
+        return 0;
+    }
+    float min[3], max[3];
+    for (int k = 0; k < 3; k++) {
+        min[k] = max[k] = vertices[k];
+    }
+    for (int v = 1; v < num_vertices; v++) {
+        for (int k = 0; k < 3; k++) {
+            min[k] = std::min(min[k], vertices[v * 3 + k]);
+            max[k] = std::max(max[k], vertices[v * 3 + k]);
+        }
+    }
+    float diagonal = sqrt((max[0] - min[0]) * (max[0] - min[0]) + (max[1] - min[1]) * (max[1] - min[1]) +
+                          (max[2] - min[2]) * (max[2] - min[2]));
+    float tolerance = relative_tolerance * diagonal;
+    float cell_size = std::max(tolerance, diagonal / (WELD_GRID_LIMIT - 2));
+    if (cell_size <= 0) {
+        cell_size = 1; // all vertices coincide; any cell size puts them in one cell
+    }
+
+    // weld: each vertex maps to the first earlier vertex within the tolerance, searched in the
+    // 27 grid cells around it; only representatives are entered into the grid
+    std::vector<int> representative(num_vertices);
+    std::vector<int> next_in_cell(num_vertices, -1);
+    std::unordered_map<unsigned long long, int> cell_heads;
+    cell_heads.reserve(num_vertices);
+    int num_welded = 0;
+    for (int v = 0; v < num_vertices; v++) {
+        const float * p = &vertices[v * 3];
+        long long cell[3];
+        for (int k = 0; k < 3; k++) {
+            cell[k] = (long long) ((p[k] - min[k]) / cell_size);
+        }
+        representative[v] = v;
+        for (int d = 0; d < 27 && representative[v] == v; d++) {
+            long long neighbor[3] = { cell[0] + d % 3 - 1, cell[1] + d / 3 % 3 - 1, cell[2] + d / 9 - 1 };
+            if (neighbor[0] < 0 || neighbor[1] < 0 || neighbor[2] < 0) {
+                continue;
+            }
+            std::unordered_map<unsigned long long, int>::iterator head =
+                cell_heads.find(neighbor[0] | neighbor[1] << 21 | neighbor[2] << 42);
+            for (int w = head == cell_heads.end() ? -1 : head->second; w != -1; w = next_in_cell[w]) {
+                const float * q = &vertices[w * 3];
+                float distance_squared = (p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1]) +
+                                         (p[2] - q[2]) * (p[2] - q[2]);
+                if (distance_squared <= tolerance * tolerance) {
+                    representative[v] = w;
+                    num_welded++;
+                    break;
+                }
+            }
+        }
+        if (representative[v] == v) {
+            unsigned long long key = cell[0] | cell[1] << 21 | cell[2] << 42;
+            std::unordered_map<unsigned long long, int>::iterator head = cell_heads.find(key);
+            if (head != cell_heads.end()) {
+                next_in_cell[v] = head->second;
+                head->second = v;
+            } else {
+                cell_heads[key] = v;
+            }
+        }
+    }
+
+    // degenerate faces
+    int num_faces = num_indices / 3;
+    std::vector<bool> keep(num_faces, true);
+    int num_degenerate = 0;
+    for (int f = 0; f < num_faces; f++) {
+        int * face = &indices[f * 3];
+        bool valid = true;
+        for (int j = 0; j < 3; j++) {
+            valid = valid && face[j] >= 0 && face[j] < num_vertices;
+            if (valid) {
+                face[j] = representative[face[j]];
+            }
+        }
+        if (valid && face[0] != face[1] && face[1] != face[2] && face[2] != face[0]) {
+            // height over the longest edge = |cross| / longest edge
+            const float * a = &vertices[face[0] * 3];
+            const float * b = &vertices[face[1] * 3];
+            const float * c = &vertices[face[2] * 3];
+            float ab[3], ac[3], bc[3];
+            for (int k = 0; k < 3; k++) {
+                ab[k] = b[k] - a[k];
+                ac[k] = c[k] - a[k];
+                bc[k] = c[k] - b[k];
+            }
+            float cross[3] = {
+                ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0]
+            };
+            float longest = sqrt(std::max(std::max(ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2],
+                                                   ac[0] * ac[0] + ac[1] * ac[1] + ac[2] * ac[2]),
+                                          bc[0] * bc[0] + bc[1] * bc[1] + bc[2] * bc[2]));
+            float twice_area = sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+            valid = twice_area > tolerance * longest && twice_area > 0;
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            keep[f] = false;
+            num_degenerate++;
+        }
+    }
+
+    // duplicate faces: the same three vertices in any order, the first occurrence stays
+    std::vector<std::pair<std::array<int, 3>, int> > sorted_faces;
+    sorted_faces.reserve(num_faces);
+    for (int f = 0; f < num_faces; f++) {
+        if (keep[f]) {
+            std::array<int, 3> key = { { indices[f * 3], indices[f * 3 + 1], indices[f * 3 + 2] } };
+            std::sort(key.begin(), key.end());
+            sorted_faces.push_back(std::make_pair(key, f));
+        }
+    }
+    std::sort(sorted_faces.begin(), sorted_faces.end());
+    int num_duplicates = 0;
+    for (unsigned int i = 1; i < sorted_faces.size(); i++) {
+        if (sorted_faces[i].first == sorted_faces[i - 1].first) {
+            keep[sorted_faces[i].second] = false;
+            num_duplicates++;
+        }
+    }
+
+    int num_unused = remove_faces(keep) - num_welded;
+
+    int num_removed = num_welded + num_unused + num_degenerate + num_duplicates;
+    if (num_removed > 0) {
+        printf("cleaned surface: welded %d vertices, dropped %d unused vertices, %d degenerate and %d duplicate faces\n",
+               num_welded, num_unused, num_degenerate, num_duplicates);
+    }
+    return num_removed;
+}
+
+// Symmetric 4x4 error quadric (Garland and Heckbert), upper triangle row by row, plus the total
+// weight of the planes in it so that errors can be read as an RMS distance
+struct Quadric {
+    double q[10];
+    double weight;
+
+    Quadric() : weight(0) {
+        for (int i = 0; i < 10; i++) {
+            q[i] = 0;
+        }
+    }
+
+    // plane n . x + d = 0 with unit normal n
+    void add_plane(const double * n, double d, double plane_weight) {
+        double p[4] = { n[0], n[1], n[2], d };
+        for (int r = 0, i = 0; r < 4; r++) {
+            for (int c = r; c < 4; c++, i++) {
+                q[i] += plane_weight * p[r] * p[c];
+            }
+        }
+        weight += plane_weight;
+    }
+
+    void add(const Quadric & other) {
+        for (int i = 0; i < 10; i++) {
+            q[i] += other.q[i];
+        }
+        weight += other.weight;
+    }
+
+    // weighted sum of squared distances from x to the planes
+    double evaluate(const double * x) const {
+        double v[4] = { x[0], x[1], x[2], 1 };
+        double error = 0;
+        for (int r = 0, i = 0; r < 4; r++) {
+            for (int c = r; c < 4; c++, i++) {
+                error += (r == c ? 1 : 2) * q[i] * v[r] * v[c];
+            }
+        }
+        return std::max(error, 0.0);
+    }
+
+    // The point of least error; false when it is not unique (flat or cylindrical neighborhoods)
+    bool minimize(double * x) const {
+        double a[3][3] = { { q[0], q[1], q[2] }, { q[1], q[4], q[5] }, { q[2], q[5], q[7] } };
+        double b[3] = { -q[3], -q[6], -q[8] };
+        double det = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+                     a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+                     a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+        double scale = q[0] + q[4] + q[7];
+        if (fabs(det) <= 1e-9 * scale * scale * scale) {
+            return false;
+        }
+        for (int k = 0; k < 3; k++) {
+            double m[3][3];
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) {
+                    m[r][c] = c == k ? b[r] : a[r][c];
+                }
+            }
+            x[k] = (m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                    m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                    m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0])) / det;
+        }
+        return true;
+    }
+};
+
+struct CollapseCandidate {
+    double cost;
+    int keep, remove;
+    unsigned int keep_stamp, remove_stamp;
+    double position[3];
+
+    bool operator>(const CollapseCandidate & other) const { return cost > other.cost; }
+};
+
+// boundary edges get a plane perpendicular to their face, this much heavier than the faces
+#define BOUNDARY_WEIGHT 100.0
+// a collapse may not turn any remaining face by more than ~78 degrees (cosine 0.2)
+#define MIN_NORMAL_COSINE 0.2
+
+static void face_normal(const double * a, const double * b, const double * c, double * n) {
+    double ab[3], ac[3];
+    vec_subtract(ab, b, a);
+    vec_subtract(ac, c, a);
+    vec_cross(n, ab, ac);
+}
+
+static double orientation(const double * a, const double * b, const double * c, const double * d) {
+    double n[3], ad[3];
+    face_normal(a, b, c, n);
+    vec_subtract(ad, d, a);
+    return vec_dot(n, ad);
+}
+
+// True if segment pq passes through the plane of triangle abc inside (or on the edge of) it
+static bool segment_crosses_triangle(const double * p, const double * q,
+                                     const double * a, const double * b, const double * c) {
+    double sp = orientation(a, b, c, p);
+    double sq = orientation(a, b, c, q);
+    if (!((sp > 0 && sq < 0) || (sp < 0 && sq > 0))) {
+        return false;
+    }
+    double s1 = orientation(p, q, a, b);
+    double s2 = orientation(p, q, b, c);
+    double s3 = orientation(p, q, c, a);
+    return (s1 >= 0 && s2 >= 0 && s3 >= 0) || (s1 <= 0 && s2 <= 0 && s3 <= 0);
+}
+
+// True if two triangles meet anywhere but at the vertices they share. Triangles sharing an edge
+// are left to the fold check, and coplanar overlaps are not detected.
+static bool triangles_intersect(const int * a_ids, const double * const * a, const int * b_ids, const double * const * b) {
+    // no crossing unless each has corners strictly on both sides of the other's plane
+    for (int side = 0; side < 2; side++) {
+        const double * const * t = side == 0 ? a : b;
+        const double * const * u = side == 0 ? b : a;
+        double lowest = 0, highest = 0;
+        for (int i = 0; i < 3; i++) {
+            double s = orientation(u[0], u[1], u[2], t[i]);
+            lowest = std::min(lowest, s);
+            highest = std::max(highest, s);
+        }
+        if (lowest >= 0 || highest <= 0) {
+            return false;
+        }
+    }
+    int num_shared = 0;
+    int a_shared = 0, b_shared = 0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            if (a_ids[i] == b_ids[j]) {
+                num_shared++;
+                a_shared = i;
+                b_shared = j;
+            }
+        }
+    }
+    if (num_shared == 1) {
+        // the two meet along a segment from the shared vertex, which has to leave one of them
+        // through the edge opposite it
+        return segment_crosses_triangle(a[(a_shared + 1) % 3], a[(a_shared + 2) % 3], b[0], b[1], b[2]) ||
+               segment_crosses_triangle(b[(b_shared + 1) % 3], b[(b_shared + 2) % 3], a[0], a[1], a[2]);
+    }
+    if (num_shared > 1) {
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (segment_crosses_triangle(a[i], a[(i + 1) % 3], b[0], b[1], b[2]) ||
+            segment_crosses_triangle(b[i], b[(i + 1) % 3], a[0], a[1], a[2])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A face as it will be after the collapse being tested, with its bounding box
+struct PlacedFace {
+    int ids[3];
+    const double * corners[3];
+    double box_min[3], box_max[3];
+
+    // keep and remove both end up at position
+    void place(const int * face, int keep, int remove, const double * position, const std::vector<double> & positions) {
+        for (int j = 0; j < 3; j++) {
+            bool merged = face[j] == keep || face[j] == remove;
+            ids[j] = merged ? keep : face[j];
+            corners[j] = merged ? position : &positions[face[j] * 3];
+        }
+        for (int k = 0; k < 3; k++) {
+            box_min[k] = std::min(std::min(corners[0][k], corners[1][k]), corners[2][k]);
+            box_max[k] = std::max(std::max(corners[0][k], corners[1][k]), corners[2][k]);
+        }
+    }
+
+    bool intersects(const PlacedFace & other) const {
+        for (int k = 0; k < 3; k++) {
+            if (box_max[k] < other.box_min[k] || other.box_max[k] < box_min[k]) {
+                return false;
+            }
+        }
+        return triangles_intersect(ids, corners, other.ids, other.corners);
+    }
+};
+
+// Cell coordinates are packed 21 bits per axis, as for the weld grid
+#define FACE_GRID_LIMIT (1 << 21)
+
+// Uniform grid over face bounding boxes, for finding the faces a moved face could cross. Each
+// face is entered in every cell its box touches.
+struct FaceGrid {
+    double min[3];
+    double cell_size;
+    std::unordered_map<unsigned long long, std::vector<int> > cells;
+    std::vector<std::array<long long, 6> > ranges; // per face: low and high cell; empty once removed
+
+    void get_cell_range(const double * box_min, const double * box_max, long long * low, long long * high) const {
+        for (int k = 0; k < 3; k++) {
+            low[k] = std::max(0LL, std::min((long long) ((box_min[k] - min[k]) / cell_size), FACE_GRID_LIMIT - 1LL));
+            high[k] = std::max(0LL, std::min((long long) ((box_max[k] - min[k]) / cell_size), FACE_GRID_LIMIT - 1LL));
+        }
+    }
+
+    void insert(int face, const double * const * corners) {
+        double box_min[3], box_max[3];
+        for (int k = 0; k < 3; k++) {
+            box_min[k] = std::min(std::min(corners[0][k], corners[1][k]), corners[2][k]);
+            box_max[k] = std::max(std::max(corners[0][k], corners[1][k]), corners[2][k]);
+        }
+        std::array<long long, 6> & range = ranges[face];
+        get_cell_range(box_min, box_max, &range[0], &range[3]);
+        for (long long z = range[2]; z <= range[5]; z++) {
+            for (long long y = range[1]; y <= range[4]; y++) {
+                for (long long x = range[0]; x <= range[3]; x++) {
+                    cells[x | y << 21 | z << 42].push_back(face);
+                }
+            }
+        }
+    }
+
+    void remove(int face) {
+        std::array<long long, 6> & range = ranges[face];
+        for (long long z = range[2]; z <= range[5]; z++) {
+            for (long long y = range[1]; y <= range[4]; y++) {
+                for (long long x = range[0]; x <= range[3]; x++) {
+                    std::vector<int> & cell = cells[x | y << 21 | z << 42];
+                    std::vector<int>::iterator entry = std::find(cell.begin(), cell.end(), face);
+                    *entry = cell.back();
+                    cell.pop_back();
+                }
+            }
+        }
+        range = { { 0, 0, 0, -1, -1, -1 } };
+    }
+
+    // Enters every face, in cells about twice the mean edge length
+    void build(const std::vector<double> & positions, const int * indices, int num_faces) {
+        int num_vertices = positions.size() / 3;
+        double max[3];
+        vec_copy(min, &positions[0]);
+        vec_copy(max, &positions[0]);
+        for (int v = 1; v < num_vertices; v++) {
+            for (int k = 0; k < 3; k++) {
+                min[k] = std::min(min[k], positions[v * 3 + k]);
+                max[k] = std::max(max[k], positions[v * 3 + k]);
+            }
+        }
+        double total_edge_length = 0;
+        for (int f = 0; f < num_faces; f++) {
+            for (int j = 0; j < 3; j++) {
+                double edge[3];
+                vec_subtract(edge, &positions[indices[f * 3 + j] * 3], &positions[indices[f * 3 + (j + 1) % 3] * 3]);
+                total_edge_length += vec_length(edge);
+            }
+        }
+        double diagonal[3];
+        vec_subtract(diagonal, max, min);
+        cell_size = std::max(2 * total_edge_length / (num_faces * 3), vec_length(diagonal) / (FACE_GRID_LIMIT - 2));
+        if (cell_size <= 0) {
+            cell_size = 1;
+        }
+        ranges.resize(num_faces);
+        for (int f = 0; f < num_faces; f++) {
+            const double * corners[3];
+            for (int j = 0; j < 3; j++) {
+                corners[j] = &positions[indices[f * 3 + j] * 3];
+            }
+            insert(f, corners);
+        }
+    }
+
+    // Appends the faces entered in the cells the box touches; a face can come up more than once
+    void find(const double * box_min, const double * box_max, std::vector<int> & faces) const {
+        long long low[3], high[3];
+        get_cell_range(box_min, box_max, low, high);
+        for (long long z = low[2]; z <= high[2]; z++) {
+            for (long long y = low[1]; y <= high[1]; y++) {
+                for (long long x = low[0]; x <= high[0]; x++) {
+                    std::unordered_map<unsigned long long, std::vector<int> >::const_iterator cell =
+                        cells.find(x | y << 21 | z << 42);
+                    if (cell != cells.end()) {
+                        faces.insert(faces.end(), cell->second.begin(), cell->second.end());
+                    }
+                }
+            }
+        }
+    }
+};
+
+int IndexedFaceSet::decimate(int target_faces, float relative_max_error) {
+    int num_faces = num_indices / 3;
+    if (num_faces == 0 || (target_faces <= 0 && relative_max_error <= 0)) {
+        return 0;
+    }
+    target_faces = std::max(target_faces, 4);
+
+    std::vector<double> positions(vertices, vertices + num_vertices * 3);
+    std::vector<std::vector<int> > vertex_faces(num_vertices);
+    for (int f = 0; f < num_faces; f++) {
+        for (int j = 0; j < 3; j++) {
+            vertex_faces[indices[f * 3 + j]].push_back(f);
+        }
+    }
+
+    // quadrics from the area-weighted face planes, plus constraint planes along open boundaries
+    std::vector<Quadric> quadrics(num_vertices);
+    double min[3], max[3];
+    vec_copy(min, &positions[0]);
+    vec_copy(max, &positions[0]);
+    for (int v = 1; v < num_vertices; v++) {
+        for (int k = 0; k < 3; k++) {
+            min[k] = std::min(min[k], positions[v * 3 + k]);
+            max[k] = std::max(max[k], positions[v * 3 + k]);
+        }
+    }
+    double diagonal[3];
+    vec_subtract(diagonal, max, min);
+    double max_error = relative_max_error * vec_length(diagonal);
+    for (int f = 0; f < num_faces; f++) {
+        const int * face = &indices[f * 3];
+        double n[3];
+        face_normal(&positions[face[0] * 3], &positions[face[1] * 3], &positions[face[2] * 3], n);
+        double length = vec_length(n);
+        if (length == 0) {
+            continue;
+        }
+        vec_divide(n, n, length);
+        double d = -vec_dot(n, &positions[face[0] * 3]);
+        for (int j = 0; j < 3; j++) {
+            quadrics[face[j]].add_plane(n, d, length / 2);
+        }
+        for (int j = 0; j < 3; j++) {
+            int a = face[j];
+            int b = face[(j + 1) % 3];
+            int num_sharing = 0;
+            for (unsigned int i = 0; i < vertex_faces[a].size(); i++) {
+                const int * other = &indices[vertex_faces[a][i] * 3];
+                num_sharing += other[0] == b || other[1] == b || other[2] == b;
+            }
+            if (num_sharing == 1) {
+                double edge[3], side[3];
+                vec_subtract(edge, &positions[b * 3], &positions[a * 3]);
+                vec_cross(side, edge, n);
+                double side_length = vec_length(side);
+                if (side_length > 0) {
+                    vec_divide(side, side, side_length);
+                    double side_d = -vec_dot(side, &positions[a * 3]);
+                    double edge_weight = BOUNDARY_WEIGHT * vec_dot(edge, edge);
+                    quadrics[a].add_plane(side, side_d, edge_weight);
+                    quadrics[b].add_plane(side, side_d, edge_weight);
+                }
+            }
+        }
+    }
+
+    FaceGrid grid;
+    grid.build(positions, indices, num_faces);
+
+    std::vector<unsigned int> stamps(num_vertices, 0);
+    std::vector<bool> face_alive(num_faces, true);
+    std::vector<unsigned int> face_checked(num_faces, 0);
+    unsigned int check_stamp = 0;
+    std::priority_queue<CollapseCandidate, std::vector<CollapseCandidate>, std::greater<CollapseCandidate> > queue;
+
+    // best placement of the merged vertex: the quadric minimizer, else the better endpoint or midpoint
+    auto push_candidate = [&](int keep, int remove) {
+        Quadric merged = quadrics[keep];
+        merged.add(quadrics[remove]);
+        CollapseCandidate candidate;
+        candidate.keep = keep;
+        candidate.remove = remove;
+        candidate.keep_stamp = stamps[keep];
+        candidate.remove_stamp = stamps[remove];
+        if (merged.minimize(candidate.position)) {
+            candidate.cost = merged.evaluate(candidate.position);
+        } else {
+            candidate.cost = -1;
+            for (int option = 0; option < 3; option++) {
+                double x[3];
+                for (int k = 0; k < 3; k++) {
+                    double p = positions[keep * 3 + k];
+                    double r = positions[remove * 3 + k];
+                    x[k] = option == 0 ? p : (option == 1 ? r : (p + r) / 2);
+                }
+                double cost = merged.evaluate(x);
+                if (candidate.cost < 0 || cost < candidate.cost) {
+                    candidate.cost = cost;
+                    vec_copy(candidate.position, x);
+                }
+            }
+        }
+        // as a squared RMS distance, comparable with max_error
+        candidate.cost = merged.weight > 0 ? candidate.cost / merged.weight : 0;
+        queue.push(candidate);
+    };
+    for (int f = 0; f < num_faces; f++) {
+        for (int j = 0; j < 3; j++) {
+            int a = indices[f * 3 + j];
+            int b = indices[f * 3 + (j + 1) % 3];
+            if (a < b) {
+                push_candidate(a, b);
+            }
+        }
+    }
+
+    std::vector<int> keep_neighbors, remove_neighbors, near_faces;
+    std::vector<std::pair<int, PlacedFace> > moved_faces;
+    int num_alive = num_faces;
+    while (num_alive > target_faces && !queue.empty()) {
+        CollapseCandidate candidate = queue.top();
+        queue.pop();
+        if (relative_max_error > 0 && candidate.cost > max_error * max_error) {
+            break;
+        }
+        int keep = candidate.keep;
+        int remove = candidate.remove;
+        if (stamps[keep] != candidate.keep_stamp || stamps[remove] != candidate.remove_stamp) {
+            continue; // one of the two has changed since the candidate was queued
+        }
+
+        // link condition: the two one-rings may only share the apexes of the faces on the edge,
+        // otherwise the collapse pinches the surface
+        keep_neighbors.clear();
+        remove_neighbors.clear();
+        int num_shared_faces = 0;
+        for (unsigned int i = 0; i < vertex_faces[keep].size(); i++) {
+            const int * face = &indices[vertex_faces[keep][i] * 3];
+            keep_neighbors.insert(keep_neighbors.end(), face, face + 3);
+            num_shared_faces += face[0] == remove || face[1] == remove || face[2] == remove;
+        }
+        for (unsigned int i = 0; i < vertex_faces[remove].size(); i++) {
+            const int * face = &indices[vertex_faces[remove][i] * 3];
+            remove_neighbors.insert(remove_neighbors.end(), face, face + 3);
+        }
+        std::sort(keep_neighbors.begin(), keep_neighbors.end());
+        keep_neighbors.erase(std::unique(keep_neighbors.begin(), keep_neighbors.end()), keep_neighbors.end());
+        std::sort(remove_neighbors.begin(), remove_neighbors.end());
+        remove_neighbors.erase(std::unique(remove_neighbors.begin(), remove_neighbors.end()), remove_neighbors.end());
+        int num_common = 0;
+        for (unsigned int i = 0; i < remove_neighbors.size(); i++) {
+            int w = remove_neighbors[i];
+            num_common += w != keep && w != remove &&
+                std::binary_search(keep_neighbors.begin(), keep_neighbors.end(), w);
+        }
+        // an interior edge between two boundary vertices would join the boundary into two loops;
+        // on a manifold, a vertex is interior exactly when it has as many neighbors as faces
+        bool keep_on_boundary = keep_neighbors.size() - 1 != vertex_faces[keep].size();
+        bool remove_on_boundary = remove_neighbors.size() - 1 != vertex_faces[remove].size();
+        if (num_shared_faces == 0 || num_shared_faces > 2 || num_common != num_shared_faces ||
+            (num_shared_faces == 2 && keep_on_boundary && remove_on_boundary) ||
+            num_alive - num_shared_faces < 4) {
+            continue;
+        }
+
+        // the faces that survive must not flip or fold
+        bool folds = false;
+        for (int side = 0; side < 2 && !folds; side++) {
+            int moved = side == 0 ? keep : remove;
+            for (unsigned int i = 0; i < vertex_faces[moved].size() && !folds; i++) {
+                const int * face = &indices[vertex_faces[moved][i] * 3];
+                if ((face[0] == keep || face[1] == keep || face[2] == keep) &&
+                    (face[0] == remove || face[1] == remove || face[2] == remove)) {
+                    continue;
+                }
+                const double * corners[3];
+                for (int j = 0; j < 3; j++) {
+                    corners[j] = face[j] == moved ? candidate.position : &positions[face[j] * 3];
+                }
+                double before[3], after[3];
+                face_normal(&positions[face[0] * 3], &positions[face[1] * 3], &positions[face[2] * 3], before);
+                face_normal(corners[0], corners[1], corners[2], after);
+                folds = vec_dot(before, after) <= MIN_NORMAL_COSINE * vec_length(before) * vec_length(after);
+            }
+        }
+        if (folds) {
+            continue;
+        }
+
+        // nor pass through another part of the surface, which tetgen would reject: each moved
+        // face is tested against the faces the grid has around all of them
+        auto is_collapsing = [&](const int * face) {
+            return (face[0] == keep || face[1] == keep || face[2] == keep) &&
+                   (face[0] == remove || face[1] == remove || face[2] == remove);
+        };
+        moved_faces.clear();
+        double box_min[3], box_max[3];
+        vec_copy(box_min, candidate.position);
+        vec_copy(box_max, candidate.position);
+        for (int side = 0; side < 2; side++) {
+            int moved = side == 0 ? keep : remove;
+            for (unsigned int i = 0; i < vertex_faces[moved].size(); i++) {
+                int f = vertex_faces[moved][i];
+                if (is_collapsing(&indices[f * 3])) {
+                    continue;
+                }
+                PlacedFace placed;
+                placed.place(&indices[f * 3], keep, remove, candidate.position, positions);
+                moved_faces.push_back(std::make_pair(f, placed));
+                for (int k = 0; k < 3; k++) {
+                    box_min[k] = std::min(box_min[k], placed.box_min[k]);
+                    box_max[k] = std::max(box_max[k], placed.box_max[k]);
+                }
+            }
+        }
+        near_faces.clear();
+        grid.find(box_min, box_max, near_faces);
+        check_stamp++;
+        bool intersects = false;
+        for (unsigned int i = 0; i < near_faces.size() && !intersects; i++) {
+            int g = near_faces[i];
+            if (!face_alive[g] || face_checked[g] == check_stamp || is_collapsing(&indices[g * 3])) {
+                continue;
+            }
+            face_checked[g] = check_stamp;
+            PlacedFace other;
+            other.place(&indices[g * 3], keep, remove, candidate.position, positions);
+            for (unsigned int m = 0; m < moved_faces.size() && !intersects; m++) {
+                intersects = moved_faces[m].first != g && moved_faces[m].second.intersects(other);
+            }
+        }
+        if (intersects) {
+            continue;
+        }
+
+        // collapse remove into keep; every face around the two moves or goes away, so they leave
+        // the grid until they are entered again at their new place
+        for (int side = 0; side < 2; side++) {
+            std::vector<int> & around = vertex_faces[side == 0 ? keep : remove];
+            for (unsigned int i = 0; i < around.size(); i++) {
+                grid.remove(around[i]);
+            }
+        }
+        for (unsigned int i = 0; i < vertex_faces[remove].size(); i++) {
+            int f = vertex_faces[remove][i];
+            int * face = &indices[f * 3];
+            if (face[0] == keep || face[1] == keep || face[2] == keep) {
+                face_alive[f] = false;
+                num_alive--;
+                for (int j = 0; j < 3; j++) {
+                    if (face[j] != remove) {
+                        std::vector<int> & list = vertex_faces[face[j]];
+                        list.erase(std::find(list.begin(), list.end(), f));
+                    }
+                }
+            } else {
+                for (int j = 0; j < 3; j++) {
+                    face[j] = face[j] == remove ? keep : face[j];
+                }
+                vertex_faces[keep].push_back(f);
+            }
+        }
+        std::vector<int>().swap(vertex_faces[remove]);
+        vec_copy(&positions[keep * 3], candidate.position);
+        quadrics[keep].add(quadrics[remove]);
+        stamps[keep]++;
+        stamps[remove]++;
+        for (unsigned int i = 0; i < vertex_faces[keep].size(); i++) {
+            const int * face = &indices[vertex_faces[keep][i] * 3];
+            const double * corners[3] = {
+                &positions[face[0] * 3], &positions[face[1] * 3], &positions[face[2] * 3]
+            };
+            grid.insert(vertex_faces[keep][i], corners);
+        }
+
+        keep_neighbors.clear();
+        for (unsigned int i = 0; i < vertex_faces[keep].size(); i++) {
+            const int * face = &indices[vertex_faces[keep][i] * 3];
+            keep_neighbors.insert(keep_neighbors.end(), face, face + 3);
+        }
+        std::sort(keep_neighbors.begin(), keep_neighbors.end());
+        keep_neighbors.erase(std::unique(keep_neighbors.begin(), keep_neighbors.end()), keep_neighbors.end());
+        for (unsigned int i = 0; i < keep_neighbors.size(); i++) {
+            if (keep_neighbors[i] != keep) {
+                push_candidate(keep, keep_neighbors[i]);
+            }
+        }
+    }
+
+    for (int v = 0; v < num_vertices; v++) {
+        for (int k = 0; k < 3; k++) {
+            vertices[v * 3 + k] = positions[v * 3 + k];
+        }
+    }
+    remove_faces(face_alive);
+    printf("decimated surface: %d -> %d faces\n", num_faces, num_alive);
+    return num_faces - num_alive;
+}
+
+int IndexedFaceSet::count_self_intersections() {
+    int num_faces = num_indices / 3;
+    if (num_faces == 0) {
+        return 0;
+    }
+    std::vector<double> positions(vertices, vertices + num_vertices * 3);
+    FaceGrid grid;
+    grid.build(positions, indices, num_faces);
+
+    int num_intersecting = 0;
+    std::vector<int> near_faces;
+    std::vector<int> face_checked(num_faces, -1);
+    for (int f = 0; f < num_faces; f++) {
+        PlacedFace face;
+        face.place(&indices[f * 3], -1, -1, NULL, positions);
+        near_faces.clear();
+        grid.find(face.box_min, face.box_max, near_faces);
+        for (unsigned int i = 0; i < near_faces.size(); i++) {
+            int g = near_faces[i];
+            // each pair once
+            if (g <= f || face_checked[g] == f) {
+                continue;
+            }
+            face_checked[g] = f;
+            PlacedFace other;
+            other.place(&indices[g * 3], -1, -1, NULL, positions);
+            num_intersecting += face.intersects(other);
+        }
+    }
+    return num_intersecting;
+}
+
 IndexedFaceSet::IndexedFaceSet(int num_vertices, float * vertices,
                                int num_indices, int * indices) {
     this->num_vertices = num_vertices;
@@ -156,12 +1072,3 @@ IndexedFaceSet::~IndexedFaceSet() {
     free(indices);
 }
 
-void IndexedFaceSet::bind_attributes(Renderable & renderable) {
-    renderable.bind_attribute(vertices, VEC3_FLOAT, num_vertices, "vertex_position");
-    renderable.bind_indices(indices, num_indices * sizeof(int));
-}
-
-
-void IndexedFaceSet::update_attributes(Renderable & renderable) {
-    renderable.bind_attribute(vertices, VEC3_FLOAT, num_vertices, "vertex_position");
-}
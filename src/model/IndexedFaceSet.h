@@ -3,21 +3,52 @@
 #ifndef _INDEXED_FACE_SET_H
 #define _INDEXED_FACE_SET_H
 
-#include "render/Renderable.h"
+#include <string>
+#include <vector>
+
 #include "tetgen.h"
 
+// Only the viewer links the GL bindings (IndexedFaceSetGL.cpp)
+class Renderable;
+
 class IndexedFaceSet {
     public:
         static IndexedFaceSet * load_from_obj(std::string file_name);
         static tetgenio * to_tetgenio(IndexedFaceSet & ifs);
         static IndexedFaceSet * surface_mesh_from_tetgenio(tetgenio & tet);
         static IndexedFaceSet * tet_mesh_from_tetgenio(tetgenio & tet);
+        // Synthetic inputs: each subdivision level multiplies the face count by 4
+        static IndexedFaceSet * create_sphere(int subdivisions, float radius);   // 20 * 4^subdivisions faces
+        static IndexedFaceSet * create_torus(int subdivisions, float major_radius,
+                                             float minor_radius);                 // 64 * 4^subdivisions faces
         IndexedFaceSet(int num_vertices, float * vertices,
                        int num_indices, int * indices);
         ~IndexedFaceSet();
+        // Welds vertices closer than relative_tolerance times the bounding box diagonal, then drops
+        // degenerate faces (repeated or out-of-range vertices, or a height below the tolerance),
+        // faces that repeat another's three vertices, and vertices no face uses. Near linear: a
+        // hash grid finds weld partners and one sort finds duplicates. Returns how many vertices
+        // and faces were removed.
+        int clean(float relative_tolerance);
+        // Quadric error edge collapse (Garland-Heckbert): collapses the cheapest edge first until
+        // target_faces remain or the next collapse would move the surface by more than
+        // relative_max_error times the bounding box diagonal (RMS over the planes it merges; 0 for
+        // no bound). Collapses that would pinch the surface, fold a face or make it intersect
+        // itself are skipped, and open boundaries are held in place. Returns how many faces were
+        // removed.
+        int decimate(int target_faces, float relative_max_error);
+        // How many pairs of faces cross each other (faces sharing an edge, and coplanar overlaps,
+        // are not counted); tetgen can't mesh a surface with any
+        int count_self_intersections();
+
         void bind_attributes(Renderable & renderable);
         void update_attributes(Renderable & renderable);
+
+        int get_num_vertices() { return num_vertices; }
+        int get_num_faces() { return num_indices / 3; }
     private:
+        int remove_faces(const std::vector<bool> & keep);
+
         int num_vertices;
         float * vertices;
 
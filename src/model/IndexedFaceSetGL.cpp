@@ -0,0 +1,13 @@
+#include "IndexedFaceSet.h"
+
+#include "render/Renderable.h"
+
+void IndexedFaceSet::bind_attributes(Renderable & renderable) {
+    renderable.bind_attribute(vertices, VEC3_FLOAT, num_vertices, "vertex_position");
+    renderable.bind_indices(indices, num_indices * sizeof(int));
+}
+
+
+void IndexedFaceSet::update_attributes(Renderable & renderable) {
+    renderable.bind_attribute(vertices, VEC3_FLOAT, num_vertices, "vertex_position");
+}
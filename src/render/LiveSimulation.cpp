@@ -0,0 +1,184 @@
+#include "LiveSimulation.h"
+
+#include <algorithm>
+
+#include "tetmesh/Scenario.h"
+#include "util/Trace.h"
+
+#define FRESH_SNAPSHOT 4
+#define SLOT_MASK 3
+#define RANGE_MERGE_GAP 64
+#define FACE_ON_HULL 0x80
+
+SnapshotBuffer::SnapshotBuffer() : back(0), front(1), middle(2) {
+}
+
+void SnapshotBuffer::publish() {
+    // release: the slot's contents are visible to whoever acquires it
+    back = middle.exchange(back | FRESH_SNAPSHOT, std::memory_order_acq_rel) & SLOT_MASK;
+}
+
+MeshSnapshot * SnapshotBuffer::acquire() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH_SNAPSHOT)) {
+        return NULL;
+    }
+    front = middle.exchange(front, std::memory_order_acq_rel) & SLOT_MASK;
+    return &slots[front];
+}
+
+LiveSimulation::LiveSimulation(int scenario)
+    : scenario(scenario), stop_requested(false), uploaded_sequence(0), sequence(0),
+      indices_changed(0) {
+    worker = std::thread(&LiveSimulation::run, this);
+}
+
+LiveSimulation::~LiveSimulation() {
+    stop_requested = true;
+    worker.join();
+}
+
+void LiveSimulation::run() {
+    TetMesh * tet_mesh;
+    {
+        TRACE_SCOPE("build_mesh");
+        tet_mesh = Scenario::create(scenario);
+    }
+    if (tet_mesh == NULL) {
+        return; // the factory has said why; the viewer stays empty
+    }
+    publish(*tet_mesh);
+    for (int stage = 0; !stop_requested && Scenario::begin_stage(*tet_mesh, scenario, stage); stage++) {
+        bool done = false;
+        while (!stop_requested && !done) {
+            done = tet_mesh->evolve_step();
+            publish(*tet_mesh);
+        }
+    }
+    delete tet_mesh;
+}
+
+// Every face of the mesh once (interior faces are shared by two tets), classified by the tets
+// on its two sides and sorted by that status
+void LiveSimulation::extract_faces(TetMesh & tet_mesh) {
+    TRACE_SCOPE("extract_faces");
+    unsigned int num_tets = tet_mesh.tets.size() / 4;
+    faces.clear();
+    face_statuses.clear();
+    face_map.clear();
+    face_map.reserve(tet_mesh.get_num_tets() * 2 + 16);
+    for (unsigned int t = 0; t < num_tets; t++) {
+        if (!tet_mesh.is_tet_alive(t)) {
+            continue;
+        }
+        status_t status = tet_mesh.get_tet_status(t);
+        for (unsigned int j = 0; j < 4; j++) {
+            Face f = tet_mesh.get_opposite_face(t, tet_mesh.tets[t * 4 + j]);
+            auto inserted = face_map.insert(std::make_pair(f, (unsigned int) face_statuses.size()));
+            if (inserted.second) {
+                faces.push_back(f.getV1());
+                faces.push_back(f.getV2());
+                faces.push_back(f.getV3());
+                // until a second tet turns up, the face is on the hull
+                face_statuses.push_back(status | FACE_ON_HULL);
+            } else {
+                unsigned char & face_status = face_statuses[inserted.first->second];
+                face_status = (face_status & ~FACE_ON_HULL) == status ? status : INTERFACE;
+            }
+        }
+    }
+
+    unsigned int num_faces = face_statuses.size();
+    unsigned int counts[4] = { 0, 0, 0, 0 };
+    for (unsigned int f = 0; f < num_faces; f++) {
+        if (face_statuses[f] & FACE_ON_HULL) {
+            face_statuses[f] = DOMAIN_BOUNDARY;
+        }
+        counts[face_statuses[f]]++;
+    }
+    face_offsets[0] = 0;
+    for (unsigned int s = 0; s < 4; s++) {
+        face_offsets[s + 1] = face_offsets[s] + counts[s];
+    }
+    unsigned int next[4] = { face_offsets[0], face_offsets[1], face_offsets[2], face_offsets[3] };
+    indices.resize(faces.size());
+    for (unsigned int f = 0; f < num_faces; f++) {
+        unsigned int slot = next[face_statuses[f]]++;
+        std::copy(&faces[f * 3], &faces[f * 3] + 3, &indices[slot * 3]);
+    }
+}
+
+void LiveSimulation::publish(TetMesh & tet_mesh) {
+    TRACE_SCOPE("publish_snapshot");
+    sequence++;
+    unsigned int num_vertices = tet_mesh.vertices.size() / 3;
+    unsigned int num_tets = tet_mesh.tets.size() / 4;
+    unsigned int old_num_vertices = positions.size() / 3;
+    positions.resize(num_vertices * 3);
+    vertex_statuses.resize(num_vertices, OUTSIDE);
+    vertex_changed.resize(num_vertices, sequence);
+
+    // moved or new vertices, and the corners of changed tets, whose statuses may have changed
+    refresh.clear();
+    for (unsigned int v = 0; v < num_vertices; v++) {
+        if (v >= old_num_vertices || tet_mesh.is_vertex_dirty(v)) {
+            refresh.push_back(v);
+        }
+    }
+    bool topology_changed = sequence == 1;
+    for (unsigned int t = 0; t < num_tets; t++) {
+        if (tet_mesh.is_tet_dirty(t)) {
+            topology_changed = true;
+            refresh.insert(refresh.end(), &tet_mesh.tets[t * 4], &tet_mesh.tets[t * 4] + 4);
+        }
+    }
+    for (unsigned int i = 0; i < refresh.size(); i++) {
+        unsigned int v = refresh[i];
+        for (unsigned int k = 0; k < 3; k++) {
+            positions[v * 3 + k] = tet_mesh.vertices[v * 3 + k];
+        }
+        if (tet_mesh.is_vertex_alive(v)) {
+            vertex_statuses[v] = tet_mesh.get_vertex_status(v);
+        }
+        vertex_changed[v] = sequence;
+    }
+    if (topology_changed) {
+        indices_changed = sequence;
+        extract_faces(tet_mesh);
+    }
+    tet_mesh.clear_dirty();
+
+    // The snapshot has to cover every change since the one the viewer last uploaded. Runs of
+    // changed vertices less than RANGE_MERGE_GAP apart are sent as one range, since a few
+    // unchanged vertices cost less to resend than another buffer update call.
+    MeshSnapshot & snapshot = snapshots.get_back();
+    snapshot.sequence = sequence;
+    snapshot.base_sequence = uploaded_sequence;
+    snapshot.indices_changed = indices_changed > snapshot.base_sequence;
+    snapshot.dirty_ranges.clear();
+    snapshot.positions.resize(positions.size());
+    snapshot.vertex_statuses.resize(vertex_statuses.size());
+    for (unsigned int v = 0; v < num_vertices; v++) {
+        if (vertex_changed[v] <= snapshot.base_sequence) {
+            continue;
+        }
+        std::vector<unsigned int> & ranges = snapshot.dirty_ranges;
+        if (!ranges.empty() && v - ranges.back() < RANGE_MERGE_GAP) {
+            ranges.back() = v + 1;
+        } else {
+            ranges.push_back(v);
+            ranges.push_back(v + 1);
+        }
+    }
+    for (unsigned int r = 0; r < snapshot.dirty_ranges.size(); r += 2) {
+        unsigned int begin = snapshot.dirty_ranges[r];
+        unsigned int end = snapshot.dirty_ranges[r + 1];
+        std::copy(positions.begin() + begin * 3, positions.begin() + end * 3, snapshot.positions.begin() + begin * 3);
+        std::copy(vertex_statuses.begin() + begin, vertex_statuses.begin() + end,
+                  snapshot.vertex_statuses.begin() + begin);
+    }
+    if (snapshot.indices_changed) {
+        snapshot.indices = indices;
+        std::copy(face_offsets, face_offsets + 5, snapshot.face_offsets);
+    }
+    snapshots.publish();
+}
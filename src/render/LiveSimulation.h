@@ -0,0 +1,95 @@
+#ifndef _LIVE_SIMULATION_H
+#define _LIVE_SIMULATION_H
+
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "tetmesh/tetmesh.h"
+
+// What the viewer draws of one moment of the simulation. Filled by the simulation thread
+// before it is published and only read by the render thread after that.
+struct MeshSnapshot {
+    unsigned long long sequence;        // 1 for the first snapshot, then counting up
+    // Only the vertices in dirty_ranges differ from snapshot base_sequence, and the indices only
+    // if indices_changed; only those parts are filled in. Base 0 means from nothing.
+    unsigned long long base_sequence;
+    std::vector<unsigned int> dirty_ranges; // begin, end pairs of vertex indices, ascending
+    bool indices_changed;
+
+    std::vector<float> positions;       // 3 per vertex
+    std::vector<int> vertex_statuses;   // status_t per vertex
+    // 3 per face, each face of the mesh once, sorted by face status: INSIDE and OUTSIDE between
+    // two such tets, INTERFACE between an inside and an outside tet and DOMAIN_BOUNDARY on the
+    // domain's hull. The faces of status s are [face_offsets[s], face_offsets[s + 1]).
+    std::vector<int> indices;
+    unsigned int face_offsets[5];
+};
+
+// Lock-free triple buffer between one producer and one consumer: the producer fills the back
+// slot and publishes it, the consumer takes the newest published one. Neither side waits;
+// snapshots published faster than the consumer takes them are skipped.
+class SnapshotBuffer {
+    public:
+        SnapshotBuffer();
+        MeshSnapshot & get_back() { return slots[back]; }
+        void publish();
+        // The newest snapshot not acquired yet, or NULL; valid until the next acquire()
+        MeshSnapshot * acquire();
+    private:
+        MeshSnapshot slots[3];
+        int back;
+        int front;
+        std::atomic<int> middle; // slot index, plus FRESH_SNAPSHOT until it is acquired
+};
+
+// Builds a scenario's mesh and evolves it on a worker thread, one TetMesh::evolve_step at a
+// time, publishing a snapshot after each. The viewer animates at its own frame rate however
+// long a step takes, and uploads only what changed since the snapshot it has on the GPU.
+class LiveSimulation {
+    public:
+        LiveSimulation(int scenario);
+        // Stops the worker after its current step (or once the mesh is built)
+        ~LiveSimulation();
+
+        MeshSnapshot * acquire_snapshot() { return snapshots.acquire(); }
+        // Tells the worker which snapshot is on the GPU, so that later ones are deltas from it
+        void set_uploaded(unsigned long long sequence) { uploaded_sequence = sequence; }
+    private:
+        struct FaceHash {
+            size_t operator()(Face f) const {
+                unsigned long long h = f.getV1();
+                h = h * 0x9E3779B97F4A7C15ULL + f.getV2();
+                h = h * 0x9E3779B97F4A7C15ULL + f.getV3();
+                return h ^ (h >> 29);
+            }
+        };
+
+        void run();
+        void publish(TetMesh & tet_mesh);
+        void extract_faces(TetMesh & tet_mesh);
+
+        int scenario;
+        SnapshotBuffer snapshots;
+        std::atomic<bool> stop_requested;
+        std::atomic<unsigned long long> uploaded_sequence;
+
+        // Worker state: the latest arrays, kept current from the mesh's dirty flags, and the
+        // snapshot in which each vertex and the indices last changed
+        unsigned long long sequence;
+        std::vector<float> positions;
+        std::vector<int> vertex_statuses;
+        std::vector<int> indices;
+        unsigned int face_offsets[5];
+        std::vector<int> faces;                    // unsorted, 3 per face
+        std::vector<unsigned char> face_statuses;  // per face
+        std::unordered_map<Face, unsigned int, FaceHash> face_map;
+        std::vector<unsigned long long> vertex_changed;
+        unsigned long long indices_changed;
+        std::vector<unsigned int> refresh;
+
+        std::thread worker; // last, so everything above is initialized before it starts
+};
+
+#endif
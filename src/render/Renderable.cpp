@@ -2,6 +2,7 @@
 #include "Renderable.h"
 
 #include <string.h>
+#include <algorithm>
 #include <utility>
 #include "render_utils.h"
 
@@ -12,9 +13,30 @@ Renderable::Renderable(Shader * shader, bool is_indexed, bool is_instanced, GLen
 
     attributes = std::vector<model_attribute_t>();
     textures = std::vector<model_texture_t>();
-    uniforms = std::unordered_map<std::string, model_uniform_t>();
+    uniforms = std::vector<model_uniform_t>();
+    uniform_handles = std::unordered_map<std::string, uniform_handle_t>();
     this->draw_mode = draw_mode;
-    indices_buffer_id = -1;
+    glGenVertexArrays(1, &vertex_array_id);
+    indices_buffer.buffer_id = 0;
+    indices_buffer.size = 0;
+    indices_buffer.capacity = 0;
+    num_indices = 0;
+}
+
+Renderable::~Renderable() {
+    for (auto it = attributes.begin(); it != attributes.end(); ++it) {
+        glDeleteBuffers(1, &it->buffer.buffer_id);
+    }
+    if (indices_buffer.buffer_id != 0) {
+        glDeleteBuffers(1, &indices_buffer.buffer_id);
+    }
+    for (auto it = textures.begin(); it != textures.end(); ++it) {
+        glDeleteTextures(1, &it->texture_id);
+    }
+    for (auto it = uniforms.begin(); it != uniforms.end(); ++it) {
+        free(it->data);
+    }
+    glDeleteVertexArrays(1, &vertex_array_id);
 }
 
 int Renderable::get_num_channels(uniform_data_t type) {
@@ -85,6 +107,42 @@ int Renderable::get_base_size(uniform_data_t type) {
     }
 }
 
+// The first upload allocates exactly and as static data; a buffer that is uploaded again is
+// being streamed, so it is updated with glBufferSubData and regrown as dynamic when too small.
+// Persistently mapped buffers would need GL 4.4, and the viewer asks for a 3.2 context.
+void Renderable::upload(GLenum target, gpu_buffer_t & gpu_buffer, const void * data, size_t size) {
+    glBindBuffer(target, gpu_buffer.buffer_id);
+    if (gpu_buffer.capacity == 0 && size > 0) {
+        glBufferData(target, size, data, GL_STATIC_DRAW);
+        gpu_buffer.capacity = size;
+    } else if (size > gpu_buffer.capacity) {
+        gpu_buffer.capacity = std::max(size, gpu_buffer.capacity * 2);
+        glBufferData(target, gpu_buffer.capacity, NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(target, 0, size, data);
+    } else if (size > 0) {
+        glBufferSubData(target, 0, size, data);
+    }
+    gpu_buffer.size = size;
+}
+
+void Renderable::capture_attribute(const model_attribute_t & attribute) {
+    glBindVertexArray(vertex_array_id);
+    glBindBuffer(GL_ARRAY_BUFFER, attribute.buffer.buffer_id);
+    glEnableVertexAttribArray(attribute.attribute_id);
+    glVertexAttribPointer(attribute.attribute_id, attribute.num_channels, attribute.gl_type, GL_FALSE, 0, NULL);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+model_attribute_t * Renderable::find_attribute(GLint attribute_location) {
+    for (auto it = attributes.begin(); it != attributes.end(); ++it) {
+        if (it->attribute_id == attribute_location) {
+            return &*it;
+        }
+    }
+    return NULL;
+}
+
 void Renderable::bind_attribute(void * buffer, uniform_data_t type, int count, char * attribute_name) {
     GLint attribute_location = glGetAttribLocation(shader->get_id(), attribute_name);
     if (attribute_location == -1) {
@@ -93,59 +151,124 @@ void Renderable::bind_attribute(void * buffer, uniform_data_t type, int count, c
     }
 
     int channels = get_num_channels(type);
-    GLuint buffer_id;
-    glGenBuffers(1, &buffer_id);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, get_base_size(type) * channels * count, buffer, GL_STATIC_DRAW);
-
-    model_attribute_t attribute = {
-		buffer_id,
-        attribute_location,
-        channels,
-        get_gl_enum(type)
-    };
+    model_attribute_t * attribute = find_attribute(attribute_location);
+    if (attribute == NULL) {
+        model_attribute_t new_attribute = {
+            { 0, 0, 0 },
+            attribute_location,
+            channels,
+            get_gl_enum(type)
+        };
+        glGenBuffers(1, &new_attribute.buffer.buffer_id);
+        attributes.push_back(new_attribute);
+        attribute = &attributes.back();
+        capture_attribute(*attribute);
+    } else if (attribute->num_channels != channels || attribute->gl_type != get_gl_enum(type)) {
+        fprintf(stderr, "attribute type does not match previous use %s\n", attribute_name);
+        return;
+    }
 
-    attributes.push_back(attribute);
+    upload(GL_ARRAY_BUFFER, attribute->buffer, buffer, (size_t) get_base_size(type) * channels * count);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     check_gl_error();
 }
 
+void Renderable::update_attribute(void * buffer, uniform_data_t type, int first, int count, int total_count,
+                                  char * attribute_name) {
+    GLint attribute_location = glGetAttribLocation(shader->get_id(), attribute_name);
+    if (attribute_location == -1) {
+        return;
+    }
+    model_attribute_t * attribute = find_attribute(attribute_location);
+    if (attribute == NULL) {
+        fprintf(stderr, "attribute %s has to be bound before it is updated\n", attribute_name);
+        return;
+    }
+
+    size_t stride = (size_t) get_base_size(type) * get_num_channels(type);
+    size_t size = stride * total_count;
+    gpu_buffer_t & gpu_buffer = attribute->buffer;
+    if (size > gpu_buffer.capacity) {
+        // grow into a new buffer and copy over the part that is not being replaced
+        GLuint old_buffer_id = gpu_buffer.buffer_id;
+        size_t kept = std::min(gpu_buffer.size, stride * first);
+        gpu_buffer.capacity = std::max(size, gpu_buffer.capacity * 2);
+        glGenBuffers(1, &gpu_buffer.buffer_id);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, gpu_buffer.buffer_id);
+        glBufferData(GL_COPY_WRITE_BUFFER, gpu_buffer.capacity, NULL, GL_DYNAMIC_DRAW);
+        if (kept > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, old_buffer_id);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, kept);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &old_buffer_id);
+        capture_attribute(*attribute);
+    }
+    gpu_buffer.size = size;
+    if (count > 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, gpu_buffer.buffer_id);
+        glBufferSubData(GL_ARRAY_BUFFER, stride * first, stride * count, (char *) buffer + stride * first);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    check_gl_error();
+}
+
 void Renderable::bind_indices(int * buffer, int size) {
-    glGenBuffers(1 , &indices_buffer_id);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_buffer_id);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, buffer, GL_STATIC_DRAW);
+    // the element array binding is part of the vertex array object
+    glBindVertexArray(vertex_array_id);
+    if (indices_buffer.buffer_id == 0) {
+        glGenBuffers(1, &indices_buffer.buffer_id);
+    }
+    upload(GL_ELEMENT_ARRAY_BUFFER, indices_buffer, buffer, size);
+    glBindVertexArray(0);
     num_indices = size / 4;
     check_gl_error();
 }
 
-void Renderable::bind_uniform(void * buffer, uniform_data_t type, int count, char * uniform_name) {
+uniform_handle_t Renderable::get_uniform_handle(uniform_data_t type, int count, char * uniform_name) {
+    auto existing = uniform_handles.find(uniform_name);
+    if (existing != uniform_handles.end()) {
+        model_uniform_t & uniform = uniforms[existing->second];
+        if (uniform.type != type || uniform.count != count) {
+            fprintf(stderr, "uniform data size does not match previous use %s\n", uniform_name);
+            return -1;
+        }
+        return existing->second;
+    }
+
     GLint uniform_location = glGetUniformLocation(shader->get_id(), uniform_name);
     if (uniform_location == -1) {
         fprintf(stderr, "could not find uniform %s\n", uniform_name);
-        return;
+        return -1;
     }
+    model_uniform_t uniform = {
+        NULL,
+        uniform_location,
+        type,
+        count
+    };
+    uniforms.push_back(uniform);
+    uniform_handle_t handle = uniforms.size() - 1;
+    uniform_handles.insert(std::pair<std::string, uniform_handle_t>(uniform_name, handle));
+    return handle;
+}
 
-    int channels = get_num_channels(type);
-    int size = get_base_size(type);
-    if (uniforms.count(uniform_name) == 0) {
-        void * copied_data = (void *) malloc(size * channels * count);
-        memcpy(copied_data, buffer, size * channels * count);
-        model_uniform_t uniform = {
-			copied_data,
-            uniform_location,
-            type,
-            count
-        };
-		uniforms.insert(std::pair<std::string, model_uniform_t>(uniform_name, uniform));
-    } else {
-        model_uniform_t uniform = uniforms.at(uniform_name);
-        if (uniform.type != type || uniform.count != count) {
-            fprintf(stderr, "uniform data size does not match previous use %s\n", uniform_name);
-            return;
-        }
-        memcpy(uniform.data, buffer, size * channels * count);
+void Renderable::set_uniform(uniform_handle_t handle, const void * buffer) {
+    if (handle < 0) {
+        return;
     }
-    check_gl_error();
+    model_uniform_t & uniform = uniforms[handle];
+    size_t size = (size_t) get_base_size(uniform.type) * get_num_channels(uniform.type) * uniform.count;
+    if (uniform.data == NULL) {
+        // never set: the shader keeps its own initial value until then
+        uniform.data = malloc(size);
+    }
+    memcpy(uniform.data, buffer, size);
+}
+
+void Renderable::bind_uniform(void * buffer, uniform_data_t type, int count, char * uniform_name) {
+    set_uniform(get_uniform_handle(type, count, uniform_name), buffer);
 }
 
 void Renderable::bind_2d_texture(const void * data, int width, int height, GLenum type, int channels, char * texture_name) {
@@ -156,10 +279,13 @@ void Renderable::bind_2d_texture(const void * data, int width, int height, GLenu
         return;
     }
 
+    // a texture bound again takes over the unit of the one it replaces
+    GLenum texture_unit = textures.size();
     for (unsigned int i = 0; i < textures.size(); i++) {
         model_texture_t tex = textures.at(i);
         if (tex.texture_uniform_id == uniform_id) {
             glDeleteTextures(1, &tex.texture_id);
+            texture_unit = tex.texture_unit;
             textures.erase(textures.begin() + i);
             break;
         }
@@ -179,7 +305,6 @@ void Renderable::bind_2d_texture(const void * data, int width, int height, GLenu
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, type, data);
     glGenerateMipmap(GL_TEXTURE_2D);
-    GLuint texture_unit = textures.size();
 
     model_texture_t texture = {
 		texture_unit,
@@ -190,12 +315,23 @@ void Renderable::bind_2d_texture(const void * data, int width, int height, GLenu
 
     textures.push_back(texture);
     glBindTexture(GL_TEXTURE_2D, 0);
+    GLint sampler = texture_unit;
+    bind_uniform(&sampler, SCALAR_INT, 1, texture_name);
 }
 
 void Renderable::render() {
+    render(0, num_indices);
+}
+
+void Renderable::render(int first, int count) {
 
 	for (auto it = uniforms.begin(); it != uniforms.end(); ++it) {
-		model_uniform_t u = it->second;
+		model_uniform_t u = *it;
+        // another Renderable drawing with the program may have sent it a different value since
+        size_t size = (size_t) get_base_size(u.type) * get_num_channels(u.type) * u.count;
+        if (u.data == NULL || !shader->update_uniform_value(u.location, u.data, size)) {
+            continue;
+        }
         switch (u.type) {
 			case SCALAR_FLOAT:
                 glUniform1fv(u.location, u.count, (GLfloat *) u.data);
@@ -237,18 +373,10 @@ void Renderable::render() {
 	for (auto it = textures.begin(); it != textures.end(); ++it) {
         glActiveTexture(it->texture_unit + GL_TEXTURE0);
         glBindTexture(it->texture_type, it->texture_id);
-        glUniform1i(it->texture_uniform_id, it->texture_unit);
     }
     check_gl_error();
 
-	for (auto it = attributes.begin(); it != attributes.end(); ++it) {
-        glEnableVertexAttribArray(it->attribute_id);
-        glBindBuffer(GL_ARRAY_BUFFER, it->buffer_id);
-        glVertexAttribPointer(it->attribute_id, it->num_channels, it->gl_type, GL_FALSE, 0, NULL);
-    }
-    check_gl_error();
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_buffer_id);
+    glBindVertexArray(vertex_array_id);
     if (is_instanced) {
         if (is_indexed) {
             // glDrawElementsInstanced(draw_mode, num_indices, GL_UNSIGNED_INT, NULL, num_instances);
@@ -257,19 +385,15 @@ void Renderable::render() {
         }
     } else {
         if (is_indexed) {
-            glDrawElements(draw_mode, num_indices, GL_UNSIGNED_INT, NULL);
+            glDrawElements(draw_mode, count, GL_UNSIGNED_INT, (void *) (first * sizeof(GLuint)));
         } else {
             // glDrawArrays(draw_mode, num_indices, GL_UNSIGNED_INT, NULL);
         }
     }
     check_gl_error();
 
-	for (auto it = attributes.begin(); it != attributes.end(); ++it) {
-        glDisableVertexAttribArray(it->attribute_id);
-    }
+    glBindVertexArray(0);
     glActiveTexture(GL_TEXTURE0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
     check_gl_error();
 }
 
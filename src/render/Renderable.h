@@ -25,8 +25,17 @@ typedef enum {
     SCALAR_SHORT
 } uniform_data_t;
 
-typedef struct _model_attribute_t {
+// Buffer storage that is allocated once and updated in place; re-uploads that outgrow it
+// reallocate at least double the capacity, so a mesh that grows while it evolves
+// reallocates O(log n) times
+typedef struct _gpu_buffer_t {
     GLuint buffer_id;
+    size_t size;       // bytes in use
+    size_t capacity;   // bytes allocated
+} gpu_buffer_t;
+
+typedef struct _model_attribute_t {
+    gpu_buffer_t buffer;
     GLint attribute_id;
     int num_channels;
     GLenum gl_type;
@@ -46,26 +55,55 @@ typedef struct _model_uniform_t {
     int count;
 } model_uniform_t;
 
+// Index of a uniform in a Renderable, from get_uniform_handle; -1 when the shader has no such uniform
+typedef int uniform_handle_t;
+
 class Renderable {
     public:
         Renderable(Shader * shader, bool is_indexed, bool is_instanced, GLenum draw_mode);
+        ~Renderable();
         int get_num_channels(uniform_data_t type);
         GLenum get_gl_enum(uniform_data_t type);
         int get_base_size(uniform_data_t type);
+        // Binding a name (or the indices) again replaces its contents in the existing buffer
         void bind_attribute(void * buffer, uniform_data_t type, int count, char * attribute_name);
         void bind_indices(int * buffer, int size);
+        // Uploads only elements [first, first + count) of buffer (the whole array) to an attribute
+        // bound before, which then holds total_count elements; those below first are kept, also
+        // when the buffer has to grow
+        void update_attribute(void * buffer, uniform_data_t type, int first, int count, int total_count,
+                              char * attribute_name);
+        // Looks the uniform up once; set_uniform then only copies the value and render() only
+        // sends values the program does not hold already (see Shader::update_uniform_value)
+        uniform_handle_t get_uniform_handle(uniform_data_t type, int count, char * uniform_name);
+        void set_uniform(uniform_handle_t handle, const void * buffer);
+        // Both of the above in one call, for values set once
         void bind_uniform(void * buffer, uniform_data_t type, int count, char * uniform_name);
+        // The sampler is set to the texture's unit like a uniform, so it is sent with the next draw
+        // and not again
         void bind_2d_texture(const void * data, int width, int height, GLenum type, int channels, char * texture_name);
         void render();
+        // Draws only indices [first, first + count), e.g. one of several ranges sorted into the
+        // index buffer
+        void render(int first, int count);
     private:
+        static void upload(GLenum target, gpu_buffer_t & gpu_buffer, const void * data, size_t size);
+        model_attribute_t * find_attribute(GLint attribute_location);
+        // Records the attribute's buffer and layout in the vertex array object
+        void capture_attribute(const model_attribute_t & attribute);
+
         Shader * shader;
+        // Holds the attribute layout and index buffer, so render() only binds it; created with
+        // the Renderable, which therefore needs a current GL context
+        GLuint vertex_array_id;
         bool is_indexed;
         bool is_instanced;
         std::vector<model_attribute_t> attributes;
         std::vector<model_texture_t> textures;
-        std::unordered_map<std::string, model_uniform_t> uniforms;
+        std::vector<model_uniform_t> uniforms;
+        std::unordered_map<std::string, uniform_handle_t> uniform_handles;
         GLenum draw_mode;
-        GLuint indices_buffer_id;
+        gpu_buffer_t indices_buffer;
         int num_indices;
 };
 
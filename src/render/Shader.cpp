@@ -13,6 +13,15 @@ int Shader::get_id() {
     return id;
 }
 
+bool Shader::update_uniform_value(GLint location, const void * data, size_t size) {
+    std::vector<char> & value = uniform_values[location];
+    if (value.size() == size && memcmp(&value[0], data, size) == 0) {
+        return false;
+    }
+    value.assign((const char *) data, (const char *) data + size);
+    return true;
+}
+
 Shader * Shader::compile_from(char * v_file, char * f_file) {
     int id = load_shaders(v_file, NULL, f_file);
     return new Shader(id);
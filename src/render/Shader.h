@@ -6,17 +6,24 @@
 
 #include <GL/glew.h>
 #include <SFML/OpenGL.hpp>
+#include <vector>
+#include <unordered_map>
 
 class Shader {
     public:
         static Shader * compile_from(char * v_file, char * f_file);
         static Shader * compile_from(char * v_file, char * g_file, char * f_file);
         int get_id();
+        // True if the program does not hold these size bytes for the uniform at location yet,
+        // which are then recorded as sent. Uniform values belong to the program, so this is
+        // shared by every Renderable drawing with it; it assumes all uniforms go through here.
+        bool update_uniform_value(GLint location, const void * data, size_t size);
     private:
         Shader(int id);
         static GLuint load_shader(char * file_name, GLenum shader_type);
         static GLuint load_shaders(char * v_file, char * g_file, char * f_file);
         int id;
+        std::unordered_map<GLint, std::vector<char> > uniform_values;
 };
 
 #endif
\ No newline at end of file
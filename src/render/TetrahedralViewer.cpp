@@ -1,6 +1,10 @@
 
 #include "TetrahedralViewer.h"
 
+#include <algorithm>
+
+#include "util/Trace.h"
+
 #define PI 3.14159f
 #define THEME_CONFIG_FILE "assets/widgets/Black.conf"
 #define UINT_32_MAX ((unsigned int) 0xffffffff)
@@ -8,6 +12,8 @@
 TetrahedralViewer::TetrahedralViewer(Renderable * r, tgui::Gui * g) {
     renderable = r;
     gui = g;
+    attributes_bound = false;
+    std::fill(face_offsets, face_offsets + 5, 0);
 }
 
 glm::vec3 TetrahedralViewer::set_eye_vector()
@@ -21,6 +27,10 @@ glm::vec3 TetrahedralViewer::set_eye_vector()
 void TetrahedralViewer::init(int window_width, int window_height, float fov) {
     glm::vec2 screen_dimensions = glm::vec2(window_width, window_height);
     renderable->bind_uniform(&screen_dimensions[0], VEC2_FLOAT, 1, "screen_dimensions");
+    mvp_uniform = renderable->get_uniform_handle(MAT4_FLOAT, 1, "MVP");
+    per_vertex_coloring_uniform = renderable->get_uniform_handle(SCALAR_INT, 1, "per_vertex_coloring");
+    opacity_uniform = renderable->get_uniform_handle(SCALAR_FLOAT, 1, "opacity");
+    face_status_uniform = renderable->get_uniform_handle(SCALAR_INT, 1, "face_status");
     model_transform = glm::mat4();
 	current_pos = sf::Vector2i(0,0);
 	radius = glm::sqrt(static_cast<glm::float32>(500));
@@ -131,60 +141,50 @@ void TetrahedralViewer::update() {
 	eye = set_eye_vector();
 	view_transform = glm::lookAt(eye, focus, up);
     glm::mat4 MVP = perspective_transform * view_transform * model_transform;
-    renderable->bind_uniform(&MVP[0][0], MAT4_FLOAT, 1, "MVP");
+    renderable->set_uniform(mvp_uniform, &MVP[0][0]);
 
     int data;
     data = per_vertex->isChecked();
-    renderable->bind_uniform(&data, SCALAR_INT, 1, "per_vertex_coloring");
-    data = outside_toggle->isChecked();
-    renderable->bind_uniform(&data, SCALAR_INT, 1, "display_outside");
-    data = inside_toggle->isChecked();
-    renderable->bind_uniform(&data, SCALAR_INT, 1, "display_inside");
-    data = interface_toggle->isChecked();
-    renderable->bind_uniform(&data, SCALAR_INT, 1, "display_interface");
-    data = error_toggle->isChecked();
-    renderable->bind_uniform(&data, SCALAR_INT, 1, "display_boundary");
+    renderable->set_uniform(per_vertex_coloring_uniform, &data);
 
     float opacity = ((float) opacity_slider->getValue()) / UINT_32_MAX;
-    renderable->bind_uniform(&opacity, SCALAR_FLOAT, 1, "opacity");
+    renderable->set_uniform(opacity_uniform, &opacity);
 }
 
-void TetrahedralViewer::bind_attributes(TetMesh & tetmesh, Renderable & renderable) {
-    // ensure vertices are not double precision
-    float * verts = new float[tetmesh.vertices.size()];
-    for (unsigned int i = 0; i < tetmesh.vertices.size(); i++) {
-        verts[i] = tetmesh.vertices[i];
+void TetrahedralViewer::render() {
+    bool displayed[4];
+    displayed[INSIDE] = inside_toggle->isChecked();
+    displayed[OUTSIDE] = outside_toggle->isChecked();
+    displayed[INTERFACE] = interface_toggle->isChecked();
+    displayed[DOMAIN_BOUNDARY] = error_toggle->isChecked();
+    for (int status = 0; status < 4; status++) {
+        unsigned int num_faces = face_offsets[status + 1] - face_offsets[status];
+        if (displayed[status] && num_faces > 0) {
+            renderable->set_uniform(face_status_uniform, &status);
+            renderable->render(face_offsets[status] * 3, num_faces * 3);
+        }
     }
-    renderable.bind_attribute(verts, VEC3_FLOAT, tetmesh.vertices.size() / 3, "vertex_position");
-    delete[] verts;
+}
 
-    int * vertex_statuses = new int[tetmesh.vertices.size() / 3];
-    for (unsigned int i = 0; i < tetmesh.vertices.size() / 3; i++) {
-        vertex_statuses[i] = (int)tetmesh.get_vertex_status(i);
-    }
-    renderable.bind_attribute(&vertex_statuses[0], SCALAR_INT, tetmesh.vertices.size() / 3, "vertex_status");
-    delete[] vertex_statuses;
-
-    unsigned int num_tets = tetmesh.tets.size() / 4;
-    unsigned int num_faces = num_tets * 4;
-    unsigned int num_indices = num_faces * 3;
-    int * indices = new int[num_indices];
-
-    unsigned int buffer_i = 0;
-    for (unsigned int i = 0; i < num_tets; i++) {
-        if (tetmesh.tet_gravestones[i] != DEAD) {
-            for (unsigned int j = 0; j < 4; j++) {
-                Face f = tetmesh.get_opposite_face(i, tetmesh.tets[i * 4 + j]);
-                indices[buffer_i * 12 + j * 3] = f.getV1();
-                indices[buffer_i * 12 + j * 3 + 1] = f.getV2();
-                indices[buffer_i * 12 + j * 3 + 2] = f.getV3();
-            }
-            buffer_i++;
+void TetrahedralViewer::bind_attributes(const MeshSnapshot & snapshot, Renderable & renderable) {
+    TRACE_SCOPE("upload_snapshot");
+    int num_vertices = snapshot.vertex_statuses.size();
+    void * positions = (void *) snapshot.positions.data();
+    void * vertex_statuses = (void *) snapshot.vertex_statuses.data();
+    if (!attributes_bound) {
+        renderable.bind_attribute(positions, VEC3_FLOAT, num_vertices, "vertex_position");
+        renderable.bind_attribute(vertex_statuses, SCALAR_INT, num_vertices, "vertex_status");
+        attributes_bound = true;
+    } else {
+        for (unsigned int r = 0; r < snapshot.dirty_ranges.size(); r += 2) {
+            int first = snapshot.dirty_ranges[r];
+            int count = snapshot.dirty_ranges[r + 1] - first;
+            renderable.update_attribute(positions, VEC3_FLOAT, first, count, num_vertices, "vertex_position");
+            renderable.update_attribute(vertex_statuses, SCALAR_INT, first, count, num_vertices, "vertex_status");
         }
     }
-
-    renderable.bind_indices(indices, buffer_i * 12 * sizeof(int));
-    delete[] indices;
+    if (snapshot.indices_changed) {
+        renderable.bind_indices((int *) snapshot.indices.data(), snapshot.indices.size() * sizeof(int));
+        std::copy(snapshot.face_offsets, snapshot.face_offsets + 5, face_offsets);
+    }
 }
-
-
@@ -5,6 +5,7 @@
 #include "tetmesh/tetmesh.h"
 #include "TetrahedralViewer.h"
 #include "Renderable.h"
+#include "LiveSimulation.h"
 #include <SFML/Graphics.hpp>
 #include <TGUI/TGUI.hpp>
 
@@ -19,13 +20,17 @@ class TetrahedralViewer {
         TetrahedralViewer(Renderable * renderable, tgui::Gui * gui);
         void init(int window_width, int window_height, float fov);
         void update();
+        // Draws the face categories that are switched on, one range of the index buffer each
+        void render();
         void handle_event(sf::Event & event);
         void handle_callback(tgui::Callback & callback);
 
-        void bind_attributes(TetMesh & tetmesh, Renderable & renderable);
+        // Uploads a snapshot; after the first, only the part that changed since the base snapshot
+        void bind_attributes(const MeshSnapshot & snapshot, Renderable & renderable);
     private:
         Renderable * renderable;
         tgui::Gui * gui;
+        bool attributes_bound;
 
         tgui::RadioButton::Ptr per_vertex;
         tgui::RadioButton::Ptr per_face;
@@ -34,6 +39,14 @@ class TetrahedralViewer {
         tgui::Checkbox::Ptr interface_toggle;
         tgui::Checkbox::Ptr error_toggle;
         tgui::Slider::Ptr opacity_slider;
+
+        // resolved in init(), set every update() or per face category
+        uniform_handle_t mvp_uniform;
+        uniform_handle_t per_vertex_coloring_uniform;
+        uniform_handle_t opacity_uniform;
+        uniform_handle_t face_status_uniform;
+
+        unsigned int face_offsets[5]; // of the snapshot whose indices are bound, see MeshSnapshot
 		
 		glm::float32 theta;
 		glm::float32 phi;
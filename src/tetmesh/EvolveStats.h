@@ -0,0 +1,185 @@
+#ifndef EVOLVE_STATS_H
+#define EVOLVE_STATS_H
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+
+#include "util/PerfCounters.h"
+
+// Timers and counters for TetMesh::evolve(). Building with DSC_NO_STATS defined turns
+// STATS_TIMER/STATS_COUNT into no-ops so the engine pays nothing for them; the record
+// itself stays so callers compile either way (it just reads zero).
+//
+// Hardware counters (instructions, cycles, LLC and branch misses) are opt-in through
+// TetMesh::set_hardware_counters() and are only sampled around advect and retesselate.
+
+typedef enum {
+    PHASE_ADVECT = 0,
+    PHASE_RETESSELATE,
+    PHASE_SPLIT_PASS,          // retesselate pass 1: split boundary/interface edges
+    PHASE_COLLAPSE_TET_PASS,   // retesselate pass 2: remove degenerate tets
+    PHASE_COLLAPSE_EDGE_PASS,  // retesselate pass 3: collapse edges between movable vertices
+    NUM_PHASES
+} evolve_phase_t;
+
+typedef enum {
+    COUNTER_ITERATIONS = 0,
+    COUNTER_SPLITS,
+    COUNTER_COLLAPSES,
+    COUNTER_FAILED_COLLAPSES,  // collapse_edge returned -1
+    COUNTER_BLOCKED_VERTICES,  // advect found a moving vertex that could not move
+    NUM_COUNTERS
+} evolve_counter_t;
+
+struct EvolveStats {
+    EvolveStats() { reset(); }
+
+    double phase_seconds[NUM_PHASES];
+    unsigned long long counters[NUM_COUNTERS];
+    bool has_hardware_counters;
+    unsigned long long hardware_counters[NUM_PHASES][NUM_HW_EVENTS];
+
+    void reset() {
+        for (int i = 0; i < NUM_PHASES; i++) {
+            phase_seconds[i] = 0;
+            for (int e = 0; e < NUM_HW_EVENTS; e++) {
+                hardware_counters[i][e] = 0;
+            }
+        }
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            counters[i] = 0;
+        }
+        has_hardware_counters = false;
+    }
+
+    void add(const EvolveStats & other) {
+        for (int i = 0; i < NUM_PHASES; i++) {
+            phase_seconds[i] += other.phase_seconds[i];
+            for (int e = 0; e < NUM_HW_EVENTS; e++) {
+                hardware_counters[i][e] += other.hardware_counters[i][e];
+            }
+        }
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            counters[i] += other.counters[i];
+        }
+        has_hardware_counters = has_hardware_counters || other.has_hardware_counters;
+    }
+
+    // Instructions per cycle of one phase, 0 if it was not sampled
+    double get_ipc(int phase) const {
+        unsigned long long cycles = hardware_counters[phase][HW_CYCLES];
+        return cycles ? (double) hardware_counters[phase][HW_INSTRUCTIONS] / cycles : 0;
+    }
+
+    static const char * get_phase_name(int phase) {
+        static const char * names[] = {
+            "advect", "retesselate", "split_pass", "collapse_tet_pass", "collapse_edge_pass"
+        };
+        return names[phase];
+    }
+
+    static const char * get_counter_name(int counter) {
+        static const char * names[] = {
+            "iterations", "splits", "collapses", "failed_collapses", "blocked_vertices"
+        };
+        return names[counter];
+    }
+
+    // One flat JSON object: "<phase>_s" for every phase and a field per counter
+    std::string to_json() const {
+        std::string json = "{";
+        char field[64];
+        for (int i = 0; i < NUM_PHASES; i++) {
+            snprintf(field, sizeof(field), "%s\"%s_s\": %.9g", i ? ", " : "", get_phase_name(i), phase_seconds[i]);
+            json += field;
+        }
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            snprintf(field, sizeof(field), ", \"%s\": %llu", get_counter_name(i), counters[i]);
+            json += field;
+        }
+        append_hardware_json(json);
+        return json + "}";
+    }
+
+    // ", \"<phase>_<event>\": n, ..., \"<phase>_ipc\": x" for every sampled phase; nothing when
+    // hardware counters were off
+    void append_hardware_json(std::string & json) const {
+        if (!has_hardware_counters) {
+            return;
+        }
+        char field[96];
+        for (int i = 0; i < NUM_PHASES; i++) {
+            if (hardware_counters[i][HW_CYCLES] == 0) {
+                continue;
+            }
+            for (int e = 0; e < NUM_HW_EVENTS; e++) {
+                snprintf(field, sizeof(field), ", \"%s_%s\": %llu", get_phase_name(i),
+                         PerfCounters::get_event_name(e), hardware_counters[i][e]);
+                json += field;
+            }
+            snprintf(field, sizeof(field), ", \"%s_ipc\": %.4f", get_phase_name(i), get_ipc(i));
+            json += field;
+        }
+    }
+};
+
+// Adds the lifetime of the enclosing scope to one phase
+class ScopedPhaseTimer {
+    public:
+        ScopedPhaseTimer(EvolveStats & stats, evolve_phase_t phase)
+            : stats(stats), phase(phase), start(std::chrono::steady_clock::now()) { }
+        ~ScopedPhaseTimer() {
+            stats.phase_seconds[phase] +=
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    private:
+        EvolveStats & stats;
+        evolve_phase_t phase;
+        std::chrono::steady_clock::time_point start;
+};
+
+// Adds the hardware events counted during the enclosing scope to one phase; a NULL
+// PerfCounters makes it a no-op
+class ScopedPhaseCounters {
+    public:
+        ScopedPhaseCounters(EvolveStats & stats, PerfCounters * perf_counters, evolve_phase_t phase)
+            : stats(stats), perf_counters(perf_counters), phase(phase) {
+            if (perf_counters != NULL && !perf_counters->read(start)) {
+                this->perf_counters = NULL;
+            }
+        }
+        ~ScopedPhaseCounters() {
+            PerfSample end;
+            if (perf_counters == NULL || !perf_counters->read(end)) {
+                return;
+            }
+            unsigned long long counts[NUM_HW_EVENTS];
+            PerfCounters::get_difference(start, end, counts);
+            for (int e = 0; e < NUM_HW_EVENTS; e++) {
+                stats.hardware_counters[phase][e] += counts[e];
+            }
+            stats.has_hardware_counters = true;
+        }
+    private:
+        EvolveStats & stats;
+        PerfCounters * perf_counters;
+        evolve_phase_t phase;
+        PerfSample start;
+};
+
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+
+#ifdef DSC_NO_STATS
+#define STATS_TIMER(stats, phase)
+#define STATS_COUNT(stats, counter)
+#define STATS_HARDWARE(stats, perf_counters, phase)
+#else
+#define STATS_TIMER(stats, phase) ScopedPhaseTimer STATS_CONCAT(stats_timer_, __LINE__)(stats, phase)
+#define STATS_COUNT(stats, counter) ((stats).counters[counter]++)
+#define STATS_HARDWARE(stats, perf_counters, phase) \
+    ScopedPhaseCounters STATS_CONCAT(stats_counters_, __LINE__)(stats, perf_counters, phase)
+#endif
+
+#endif
@@ -0,0 +1,283 @@
+#include "MeshCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#endif
+
+#include "util/Trace.h"
+
+// bump whenever the file layout or the meaning of the cached data changes
+#define CACHE_FORMAT_VERSION 2
+#define DEFAULT_CACHE_MAX_MB 1024
+#define CACHE_EXTENSION ".mesh"
+#define STALE_TEMPORARY_SECONDS (24 * 60 * 60)
+
+static const char CACHE_MAGIC[8] = { 'I', 'D', 'S', 'C', 'M', 'S', 'H', '\0' };
+
+struct CacheHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int coord_size;
+    unsigned long long key;
+    unsigned int num_points;
+    unsigned int num_tets;
+};
+
+// 64-bit FNV-1a
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static void hash_bytes(unsigned long long & hash, const void * data, size_t size) {
+    const unsigned char * bytes = (const unsigned char *) data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+}
+
+template <typename T>
+static void hash_value(unsigned long long & hash, T value) {
+    hash_bytes(hash, &value, sizeof(value));
+}
+
+unsigned long long MeshCache::get_key(tetgenio & input, const char * switches) {
+    unsigned long long hash = FNV_OFFSET_BASIS;
+    hash_value(hash, CACHE_FORMAT_VERSION);
+    hash_value(hash, (unsigned int) sizeof(coord_t));
+    hash_bytes(hash, switches, strlen(switches) + 1);
+
+    hash_value(hash, input.numberofpoints);
+    hash_bytes(hash, input.pointlist, input.numberofpoints * 3 * sizeof(REAL));
+    hash_value(hash, input.numberofpointmtrs);
+    if (input.pointmtrlist != NULL) {
+        hash_bytes(hash, input.pointmtrlist, input.numberofpoints * input.numberofpointmtrs * sizeof(REAL));
+    }
+
+    hash_value(hash, input.numberoffacets);
+    for (int f = 0; f < input.numberoffacets; f++) {
+        tetgenio::facet & facet = input.facetlist[f];
+        hash_value(hash, facet.numberofpolygons);
+        for (int p = 0; p < facet.numberofpolygons; p++) {
+            hash_value(hash, facet.polygonlist[p].numberofvertices);
+            hash_bytes(hash, facet.polygonlist[p].vertexlist, facet.polygonlist[p].numberofvertices * sizeof(int));
+        }
+        hash_value(hash, facet.numberofholes);
+        if (facet.holelist != NULL) {
+            hash_bytes(hash, facet.holelist, facet.numberofholes * 3 * sizeof(REAL));
+        }
+    }
+    if (input.facetmarkerlist != NULL) {
+        hash_bytes(hash, input.facetmarkerlist, input.numberoffacets * sizeof(int));
+    }
+
+    hash_value(hash, input.numberofregions);
+    if (input.regionlist != NULL) {
+        hash_bytes(hash, input.regionlist, input.numberofregions * 5 * sizeof(REAL));
+    }
+    return hash;
+}
+
+std::string MeshCache::get_directory() {
+    const char * directory = getenv("IDSC_CACHE_DIR");
+    if (directory != NULL) {
+        return directory;
+    }
+    const char * home = getenv("HOME");
+    if (home == NULL || home[0] == '\0') {
+        return "";
+    }
+    return std::string(home) + "/.cache/idsc";
+}
+
+std::string MeshCache::get_path(const std::string & directory, unsigned long long key) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx" CACHE_EXTENSION, key);
+    return directory + name;
+}
+
+#ifndef _WIN32
+
+bool MeshCache::load(unsigned long long key, std::vector<coord_t> & points,
+                     std::vector<unsigned int> & tets, std::vector<int> & tet_regions) {
+    std::string directory = get_directory();
+    if (directory.empty()) {
+        return false;
+    }
+    TRACE_SCOPE("mesh_cache_load");
+    std::string path = get_path(directory, key);
+    FILE * file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    CacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+        header.version == CACHE_FORMAT_VERSION && header.coord_size == sizeof(coord_t) && header.key == key;
+    if (valid) {
+        // the size has to match exactly, so a truncated file is never half-loaded
+        struct stat info;
+        size_t expected = sizeof(header) + (size_t) header.num_points * 3 * sizeof(coord_t) +
+            (size_t) header.num_tets * (4 * sizeof(unsigned int) + sizeof(int));
+        valid = fstat(fileno(file), &info) == 0 && (size_t) info.st_size == expected;
+    }
+    if (valid) {
+        points.resize((size_t) header.num_points * 3);
+        tets.resize((size_t) header.num_tets * 4);
+        tet_regions.resize(header.num_tets);
+        valid = fread(points.data(), sizeof(coord_t), points.size(), file) == points.size() &&
+            fread(tets.data(), sizeof(unsigned int), tets.size(), file) == tets.size() &&
+            fread(tet_regions.data(), sizeof(int), tet_regions.size(), file) == tet_regions.size();
+    }
+    fclose(file);
+
+    if (!valid) {
+        fprintf(stderr, "warning: ignoring invalid mesh cache entry %s\n", path.c_str());
+        unlink(path.c_str());
+        return false;
+    }
+    for (size_t i = 0; i < tets.size(); i++) {
+        if (tets[i] >= header.num_points) {
+            fprintf(stderr, "warning: ignoring invalid mesh cache entry %s\n", path.c_str());
+            unlink(path.c_str());
+            return false;
+        }
+    }
+    // eviction goes by modification time, so a hit counts as a use
+    utime(path.c_str(), NULL);
+    return true;
+}
+
+static bool make_directories(const std::string & path) {
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+        std::string prefix = path.substr(0, slash);
+        if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        if (slash == std::string::npos) {
+            return true;
+        }
+    }
+}
+
+void MeshCache::store(unsigned long long key, const std::vector<coord_t> & points,
+                      const std::vector<unsigned int> & tets, const std::vector<int> & tet_regions) {
+    std::string directory = get_directory();
+    if (directory.empty()) {
+        return;
+    }
+    TRACE_SCOPE("mesh_cache_store");
+    if (!make_directories(directory)) {
+        fprintf(stderr, "warning: could not create mesh cache directory %s: %s\n", directory.c_str(), strerror(errno));
+        return;
+    }
+
+    std::string path = get_path(directory, key);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp.%d", (int) getpid());
+    std::string temporary_path = path + suffix;
+    FILE * file = fopen(temporary_path.c_str(), "wb");
+    if (file == NULL) {
+        fprintf(stderr, "warning: could not write mesh cache entry %s: %s\n", temporary_path.c_str(), strerror(errno));
+        return;
+    }
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_FORMAT_VERSION;
+    header.coord_size = sizeof(coord_t);
+    header.key = key;
+    header.num_points = points.size() / 3;
+    header.num_tets = tet_regions.size();
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(points.data(), sizeof(coord_t), points.size(), file) == points.size() &&
+        fwrite(tets.data(), sizeof(unsigned int), tets.size(), file) == tets.size() &&
+        fwrite(tet_regions.data(), sizeof(int), tet_regions.size(), file) == tet_regions.size();
+    written = fclose(file) == 0 && written;
+
+    // rename replaces atomically, so concurrent runs on the same input just race to the same file
+    if (!written || rename(temporary_path.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "warning: could not write mesh cache entry %s\n", path.c_str());
+        unlink(temporary_path.c_str());
+        return;
+    }
+    evict(directory);
+}
+
+struct CacheEntry {
+    std::string path;
+    time_t last_used;
+    off_t size;
+
+    bool operator<(const CacheEntry & other) const { return last_used < other.last_used; }
+};
+
+// Removes least recently used entries until the directory fits the size limit, plus temporary
+// files left behind by runs that died mid-write
+void MeshCache::evict(const std::string & directory) {
+    const char * limit = getenv("IDSC_CACHE_MAX_MB");
+    off_t max_bytes = (off_t) ((limit != NULL ? atof(limit) : DEFAULT_CACHE_MAX_MB) * 1024 * 1024);
+
+    DIR * dir = opendir(directory.c_str());
+    if (dir == NULL) {
+        return;
+    }
+    std::vector<CacheEntry> entries;
+    off_t total = 0;
+    time_t now = time(NULL);
+    for (struct dirent * item = readdir(dir); item != NULL; item = readdir(dir)) {
+        std::string name = item->d_name;
+        bool is_entry = name.size() > strlen(CACHE_EXTENSION) &&
+            name.compare(name.size() - strlen(CACHE_EXTENSION), std::string::npos, CACHE_EXTENSION) == 0;
+        bool is_temporary = name.find(CACHE_EXTENSION ".tmp.") != std::string::npos;
+        struct stat info;
+        std::string path = directory + "/" + name;
+        if ((!is_entry && !is_temporary) || stat(path.c_str(), &info) != 0) {
+            continue;
+        }
+        if (is_temporary) {
+            if (now - info.st_mtime > STALE_TEMPORARY_SECONDS) {
+                unlink(path.c_str());
+            }
+            continue;
+        }
+        CacheEntry entry = { path, info.st_mtime, info.st_size };
+        entries.push_back(entry);
+        total += info.st_size;
+    }
+    closedir(dir);
+
+    std::sort(entries.begin(), entries.end());
+    for (size_t i = 0; i < entries.size() && total > max_bytes; i++) {
+        if (unlink(entries[i].path.c_str()) == 0) {
+            total -= entries[i].size;
+        }
+    }
+}
+
+#else
+
+bool MeshCache::load(unsigned long long key, std::vector<coord_t> & points,
+                     std::vector<unsigned int> & tets, std::vector<int> & tet_regions) {
+    return false;
+}
+
+void MeshCache::store(unsigned long long key, const std::vector<coord_t> & points,
+                      const std::vector<unsigned int> & tets, const std::vector<int> & tet_regions) {
+}
+
+void MeshCache::evict(const std::string & directory) {
+}
+
+#endif
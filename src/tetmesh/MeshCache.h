@@ -0,0 +1,41 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <string>
+#include <vector>
+
+#include "tetmesh.h"
+
+// On-disk cache of tetgen results, keyed by a hash of everything tetgen is given: the input
+// points, facets, regions and point sizes, and the switches. TetMeshFactory looks a mesh up
+// here before calling tetrahedralize, so repeat runs on the same surface skip meshing.
+// Points are kept in coord_t, so double and --float-coords builds have separate entries and
+// either reads its arrays straight into the mesh's storage type. Entries hold tetgen's raw
+// output, region attributes included, and the factory labels regions after loading, so a
+// change to the labeling never serves statuses derived by an older one.
+//
+// Files live in $IDSC_CACHE_DIR (default ~/.cache/idsc; set it empty to turn the cache off)
+// as <key>.mesh. They are written to a temporary name and renamed into place, so a reader
+// never sees a partial file, and the least recently used ones are removed once the directory
+// grows past $IDSC_CACHE_MAX_MB (default 1024). POSIX only; elsewhere every lookup misses.
+
+class MeshCache {
+    public:
+        static unsigned long long get_key(tetgenio & input, const char * switches);
+
+        // False on a miss or an unreadable/truncated entry
+        static bool load(unsigned long long key, std::vector<coord_t> & points,
+                         std::vector<unsigned int> & tets, std::vector<int> & tet_regions);
+        // Failures are reported and otherwise ignored; the cache is only an optimization
+        static void store(unsigned long long key, const std::vector<coord_t> & points,
+                          const std::vector<unsigned int> & tets, const std::vector<int> & tet_regions);
+
+        // Empty when the cache is disabled
+        static std::string get_directory();
+
+    private:
+        static std::string get_path(const std::string & directory, unsigned long long key);
+        static void evict(const std::string & directory);
+};
+
+#endif
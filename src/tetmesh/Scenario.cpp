@@ -0,0 +1,138 @@
+#include "Scenario.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "TetMeshFactory.h"
+#include "model/IndexedFaceSet.h"
+
+#define PI 3.14159f
+
+static TetMesh * from_obj(const char * file_name) {
+    IndexedFaceSet * mesh = IndexedFaceSet::load_from_obj(file_name);
+    TetMesh * tet_mesh = TetMeshFactory::from_indexed_face_set(*mesh);
+    delete mesh;
+    return tet_mesh;
+}
+
+#define LATTICE_SPHERE_RADIUS 1.0
+#define LATTICE_DOMAIN_SIZE 2.0
+#define LATTICE_CELL_SIZE 0.4
+
+static TetMesh * lattice_sphere() {
+    REAL min[] = { -LATTICE_DOMAIN_SIZE, -LATTICE_DOMAIN_SIZE, -LATTICE_DOMAIN_SIZE };
+    REAL max[] = { LATTICE_DOMAIN_SIZE, LATTICE_DOMAIN_SIZE, LATTICE_DOMAIN_SIZE };
+    LatticeOptions options;
+    options.cell_size = LATTICE_CELL_SIZE;
+    return TetMeshFactory::from_signed_distance([](const REAL * p) {
+        return sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]) - LATTICE_SPHERE_RADIUS;
+    }, min, max, options);
+}
+
+const char * Scenario::get_name(int scenario) {
+    switch (scenario) {
+        case 2:
+            return "debug";
+        case 3:
+            return "big_debug";
+        case 4:
+            return "collapsed";
+        case 5:
+            return "rotated_sphere";
+        case 6:
+            return "c_mesh";
+        case 7:
+            return "stretched_sphere";
+        case 8:
+            return "lattice_sphere";
+        default:
+            return "sphere";
+    }
+}
+
+TetMesh * Scenario::create(int scenario) {
+    switch (scenario) {
+        case 2:
+            return TetMeshFactory::create_debug_tetmesh();
+        case 3:
+            return TetMeshFactory::create_big_debug_tetmesh();
+        case 4:
+            return TetMeshFactory::create_collapsed_tetmesh();
+        case 6:
+            return from_obj("assets/models/c_mesh.obj");
+        case 8:
+            return lattice_sphere();
+        default:
+            return from_obj("assets/models/sphere.obj");
+    }
+}
+
+#define ROTATION_STAGES 55
+
+bool Scenario::begin_stage(TetMesh & tet_mesh, int scenario, int stage) {
+    if (scenario == 5) { // Rotated sphere tetmesh, one degree per stage
+        tet_mesh.report_tet_quality();
+        if (stage >= ROTATION_STAGES) {
+            return false;
+        }
+        REAL angle = PI / 180;
+        REAL c = cos(angle);
+        REAL s = sin(angle);
+        for (unsigned int i = 0; i < tet_mesh.vertices.size() / 3; i++) {
+            if (tet_mesh.get_vertex_status(i) == INTERFACE) {
+                // rotate about the x axis
+                REAL y = tet_mesh.vertices[i * 3 + 1];
+                REAL z = tet_mesh.vertices[i * 3 + 2];
+                tet_mesh.vertex_targets[i * 3] = tet_mesh.vertices[i * 3];
+                tet_mesh.vertex_targets[i * 3 + 1] = y * c - z * s;
+                tet_mesh.vertex_targets[i * 3 + 2] = y * s + z * c;
+                tet_mesh.set_vertex_state(i, MOVING);
+            }
+        }
+        printf("Evolving tet mesh (%d deg)...\n", stage + 1);
+        return true;
+    }
+
+    if (stage > 0) {
+        return false;
+    }
+
+    if (scenario == 6) { // C-mesh
+        for (unsigned int i = 0; i < tet_mesh.vertices.size() / 3; i++) {
+            if (tet_mesh.get_vertex_status(i) == INTERFACE) {
+                tet_mesh.vertex_targets[i * 3] = tet_mesh.vertices[i * 3];
+                tet_mesh.vertex_targets[i * 3 + 2] = tet_mesh.vertices[i * 3 + 2];
+                if (tet_mesh.vertices[i * 3] == 0.64f && tet_mesh.vertices[i * 3 + 1] == 0.10f) {
+                    tet_mesh.vertex_targets[i * 3 + 1] = -0.10f; // Moves to create C Mesh case
+                } else {
+                    tet_mesh.vertex_targets[i * 3 + 1] = tet_mesh.vertices[i * 3 + 1];
+                }
+                tet_mesh.set_vertex_state(i, MOVING);
+            }
+        }
+        printf("Evolving tet mesh from C mesh...\n");
+        return true;
+    }
+
+    if (scenario == 7 || scenario == 8) { // Stretched sphere
+        REAL scale = 1.2;
+        for (unsigned int i = 0; i < tet_mesh.vertices.size() / 3; i++) {
+            if (tet_mesh.get_vertex_status(i) == INTERFACE) {
+                // scale x
+                tet_mesh.vertex_targets[i * 3] = tet_mesh.vertices[i * 3] * scale;
+                tet_mesh.vertex_targets[i * 3 + 1] = tet_mesh.vertices[i * 3 + 1];
+                tet_mesh.vertex_targets[i * 3 + 2] = tet_mesh.vertices[i * 3 + 2];
+                tet_mesh.set_vertex_state(i, MOVING);
+            }
+        }
+    }
+
+    printf("Evolving tet mesh ...\n");
+    return true;
+}
+
+void Scenario::evolve(TetMesh & tet_mesh, int scenario) {
+    for (int stage = 0; begin_stage(tet_mesh, scenario, stage); stage++) {
+        tet_mesh.evolve();
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include "tetmesh.h"
+
+/*
+ * The canned mesh cases shared by the viewer and the headless tools:
+ * 1: Sphere
+ * 2: Debug tetmesh
+ * 3: Big debug tetmesh
+ * 4: Collapsed tetmesh
+ * 5: Sphere, rotated
+ * 6: C-mesh, joining together
+ * 7: Sphere, stretched in the x-direction
+ * 8: Implicit sphere meshed on a BCC lattice (no tetgen), stretched 5% in the x-direction
+ * Any other number falls back to scenario 1.
+ */
+class Scenario {
+    public:
+        static const int NUM_SCENARIOS = 8;
+
+        static const char * get_name(int scenario);
+        // Builds the starting tet mesh for the scenario (the "factory" phase); NULL if the
+        // factory fails
+        static TetMesh * create(int scenario);
+        // Sets vertex targets and evolves the mesh the way the scenario prescribes
+        static void evolve(TetMesh & tet_mesh, int scenario);
+        // evolve() one stage at a time: sets the targets for the scenario's stage-th evolve
+        // (counting from 0), or returns false once every stage has run. Scenario 5 has one
+        // stage per degree of rotation, the others one.
+        static bool begin_stage(TetMesh & tet_mesh, int scenario, int stage);
+};
+
+#endif
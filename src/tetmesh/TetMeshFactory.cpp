@@ -1,50 +1,184 @@
 
 #include "TetMeshFactory.h"
 
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "MeshCache.h"
+#include "util/Trace.h"
 #include "util/vec.h"
 
-// assumes interface will not evolve beyond [-10, 10]^3 and encloses the point (0, 0, 0)
+MeshingOptions TetMeshFactory::default_options;
+
+// marks the region between the surface and the domain cube; tetgen numbers the unseeded
+// regions from 1, one per connected region of what the surface encloses
+#define OUTER_REGION_ATTRIBUTE -1
+
+#define PI 3.14159265358979
+
+// Built as a library, tetgen throws its exit code instead of exiting (terminatetetgen)
+static const char * get_tetgen_error(int code) {
+    switch (code) {
+        case 1:
+            return "out of memory";
+        case 3:
+            return "the surface intersects itself";
+        case 4:
+            return "an input feature is too small";
+        case 5:
+            return "two input faces are too close";
+        case 10:
+            return "invalid input";
+        default:
+            return "internal error";
+    }
+}
+
+struct RegionFace {
+    unsigned int v[3];
+    int region;
+
+    bool operator<(const RegionFace & other) const {
+        return std::lexicographical_compare(v, v + 3, other.v, other.v + 3);
+    }
+    bool same_face(const RegionFace & other) const {
+        return v[0] == other.v[0] && v[1] == other.v[1] && v[2] == other.v[2];
+    }
+};
+
+// Shells can nest (a hollow body, a body in a cavity), so being enclosed is not enough: a
+// region is INSIDE when it is an odd number of shells away from the outer region. tetgen only
+// splits regions at surface faces, so two regions sharing a face are one shell apart, and a
+// breadth-first walk from the outer region gives every region its depth.
+static std::vector<element_info_t> label_regions(const std::vector<unsigned int> & tetrahedra,
+                                                 const std::vector<int> & regions) {
+    TRACE_SCOPE("label_regions");
+    int max_region = OUTER_REGION_ATTRIBUTE;
+    for (size_t i = 0; i < regions.size(); i++) {
+        max_region = std::max(max_region, regions[i]);
+    }
+    unsigned int num_regions = max_region - OUTER_REGION_ATTRIBUTE + 1;
+
+    std::vector<RegionFace> faces;
+    faces.reserve(tetrahedra.size());
+    for (size_t i = 0; i < regions.size(); i++) {
+        for (int k = 0; k < 4; k++) {
+            RegionFace face;
+            for (int j = 0; j < 3; j++) {
+                face.v[j] = tetrahedra[i * 4 + (k + 1 + j) % 4];
+            }
+            std::sort(face.v, face.v + 3);
+            face.region = regions[i] - OUTER_REGION_ATTRIBUTE;
+            faces.push_back(face);
+        }
+    }
+    std::sort(faces.begin(), faces.end());
+    std::vector<std::vector<unsigned int> > neighbours(num_regions);
+    for (size_t i = 0; i + 1 < faces.size(); i++) {
+        if (faces[i].same_face(faces[i + 1]) && faces[i].region != faces[i + 1].region) {
+            neighbours[faces[i].region].push_back(faces[i + 1].region);
+            neighbours[faces[i + 1].region].push_back(faces[i].region);
+        }
+    }
+    std::vector<RegionFace>().swap(faces);
+
+    std::vector<int> depth(num_regions, -1);
+    std::vector<unsigned int> queue(1, 0);
+    depth[0] = 0;
+    for (size_t q = 0; q < queue.size(); q++) {
+        unsigned int region = queue[q];
+        for (size_t n = 0; n < neighbours[region].size(); n++) {
+            unsigned int neighbour = neighbours[region][n];
+            if (depth[neighbour] == -1) {
+                depth[neighbour] = depth[region] + 1;
+                queue.push_back(neighbour);
+            }
+        }
+    }
+
+    std::vector<element_info_t> statuses(regions.size());
+    for (size_t i = 0; i < regions.size(); i++) {
+        statuses[i] = depth[regions[i] - OUTER_REGION_ATTRIBUTE] % 2 == 1 ? INSIDE : OUTSIDE;
+    }
+    return statuses;
+}
+
 TetMesh * TetMeshFactory::from_indexed_face_set(IndexedFaceSet & ifs) {
-    tetgenio * inner_input = IndexedFaceSet::to_tetgenio(ifs);
+    return from_indexed_face_set(ifs, default_options);
+}
+
+TetMesh * TetMeshFactory::from_indexed_face_set(IndexedFaceSet & ifs, const MeshingOptions & options) {
+    TRACE_SCOPE("factory_build");
+    if (!(options.domain_margin > 0)) {
+        // with no margin the box can coincide with a box-shaped surface
+        printf("error: the domain margin has to be positive, not %g\n", (double) options.domain_margin);
+        return NULL;
+    }
+    if (options.weld_tolerance > 0) {
+        // duplicate vertices and degenerate faces make tetgen slow or fail, and the ones that
+        // get through become slivers at the interface
+        TRACE_SCOPE("clean_surface");
+        ifs.clean(options.weld_tolerance);
+    }
+    if (options.face_budget > 0 || options.max_decimation_error > 0) {
+        TRACE_SCOPE("decimate_surface");
+        ifs.decimate(options.face_budget, options.max_decimation_error);
+    }
+    tetgenio * input = IndexedFaceSet::to_tetgenio(ifs);
+
+    // domain box from the input's bounding box plus the margin
+    int orig_num_v = input->numberofpoints;
+    REAL min[3], max[3];
+    vec_copy(min, input->pointlist);
+    vec_copy(max, input->pointlist);
+    for (int i = 1; i < orig_num_v; i++) {
+        for (int k = 0; k < 3; k++) {
+            REAL x = input->pointlist[i * 3 + k];
+            min[k] = x < min[k] ? x : min[k];
+            max[k] = x > max[k] ? x : max[k];
+        }
+    }
+    REAL largest_extent = 0;
+    for (int k = 0; k < 3; k++) {
+        largest_extent = max[k] - min[k] > largest_extent ? max[k] - min[k] : largest_extent;
+    }
+    REAL margin = options.domain_margin * largest_extent;
+    for (int k = 0; k < 3; k++) {
+        min[k] -= margin;
+        max[k] += margin;
+    }
 
-    tetgenio * outer_input = IndexedFaceSet::to_tetgenio(ifs);
     //add outer cube vertices
-    int orig_num_v = outer_input->numberofpoints;
-    outer_input->numberofpoints += 8;
-    REAL * new_vertices = new REAL[outer_input->numberofpoints * 3];
+    input->numberofpoints += 8;
+    REAL * new_vertices = new REAL[input->numberofpoints * 3];
     for (int i = 0; i < orig_num_v * 3; i++) {
-        new_vertices[i] = outer_input->pointlist[i];
-    }
-
-    // TODO: for robustness, generate size based on bounding sphere
-    static const REAL cube_corners[] = {
-        10, 10, 10,
-        10, 10, -10,
-        10, -10, 10,
-        10, -10, -10,
-        -10, 10, 10,
-        -10, 10, -10,
-        -10, -10, 10,
-        -10, -10, -10
-    };
+        new_vertices[i] = input->pointlist[i];
+    }
 
-    for (int i = 0; i < 8 * 3; i++) {
-        new_vertices[orig_num_v * 3 + i] = cube_corners[i];
+    // bit 2 - k of the corner index selects min or max on axis k; cube_faces relies on this order
+    for (int c = 0; c < 8; c++) {
+        for (int k = 0; k < 3; k++) {
+            new_vertices[(orig_num_v + c) * 3 + k] = (c >> (2 - k)) & 1 ? min[k] : max[k];
+        }
     }
 
-    delete[] outer_input->pointlist;
-    outer_input->pointlist = new_vertices;
+    delete[] input->pointlist;
+    input->pointlist = new_vertices;
 
     //add outer cube faces
-    int orig_num_f = outer_input->numberoffacets;
-    outer_input->numberoffacets += 6;
-    tetgenio::facet * new_facets = new tetgenio::facet[outer_input->numberoffacets];
-    delete[] outer_input->facetmarkerlist;
-    outer_input->facetmarkerlist = new int[outer_input->numberoffacets];
+    int orig_num_f = input->numberoffacets;
+    input->numberoffacets += 6;
+    tetgenio::facet * new_facets = new tetgenio::facet[input->numberoffacets];
+    delete[] input->facetmarkerlist;
+    input->facetmarkerlist = new int[input->numberoffacets];
     for (int i = 0; i < orig_num_f; i++) {
-        new_facets[i] = outer_input->facetlist[i];
+        new_facets[i] = input->facetlist[i];
+        input->facetmarkerlist[i] = 0;
     }
 
     static const int cube_faces[] = {
@@ -67,86 +201,494 @@ TetMesh * TetMeshFactory::from_indexed_face_set(IndexedFaceSet & ifs) {
         new_facets[orig_num_f + i].polygonlist[0].vertexlist[1] = orig_num_v + cube_faces[i * 4 + 1];
         new_facets[orig_num_f + i].polygonlist[0].vertexlist[2] = orig_num_v + cube_faces[i * 4 + 2];
         new_facets[orig_num_f + i].polygonlist[0].vertexlist[3] = orig_num_v + cube_faces[i * 4 + 3];
+        input->facetmarkerlist[orig_num_f + i] = 0;
     }
 
-    delete[] outer_input->facetlist;
-    outer_input->facetlist = new_facets;
+    delete[] input->facetlist;
+    input->facetlist = new_facets;
 
-    // add hole at (0, 0, 0)
-    outer_input->numberofholes = 1;
-    outer_input->holelist = new REAL[3];
-    outer_input->holelist[0] = 0;
-    outer_input->holelist[1] = 0;
-    outer_input->holelist[2] = 0;
+    // seed the outer region just inside a domain corner, where no surface reaches; whatever
+    // the surface encloses (one body, several, nested shells) ends up in other regions, which
+    // label_regions sorts into INSIDE and OUTSIDE
+    input->numberofregions = 1;
+    input->regionlist = new REAL[5];
+    for (int k = 0; k < 3; k++) {
+        input->regionlist[k] = max[k] - (max[k] - min[k]) * 0.001;
+    }
+    input->regionlist[3] = OUTER_REGION_ATTRIBUTE;
+    input->regionlist[4] = -1; // no volume constraint
+
+    // sizing: each surface point asks for its mean incident edge length, the corners for the
+    // far-field size; tetgen interpolates in between, so tets coarsen away from the surface
+    const char * switches_string = "pYqAQ";
+    if (options.grading) {
+        input->numberofpointmtrs = 1;
+        input->pointmtrlist = new REAL[input->numberofpoints];
+        std::vector<int> num_edges(orig_num_v, 0);
+        for (int i = 0; i < orig_num_v; i++) {
+            input->pointmtrlist[i] = 0;
+        }
+        for (int f = 0; f < orig_num_f; f++) {
+            tetgenio::polygon & polygon = input->facetlist[f].polygonlist[0];
+            for (int j = 0; j < polygon.numberofvertices; j++) {
+                int a = polygon.vertexlist[j];
+                int b = polygon.vertexlist[(j + 1) % polygon.numberofvertices];
+                REAL edge[3];
+                vec_subtract(edge, &input->pointlist[a * 3], &input->pointlist[b * 3]);
+                REAL length = vec_length(edge);
+                input->pointmtrlist[a] += length;
+                input->pointmtrlist[b] += length;
+                num_edges[a]++;
+                num_edges[b]++;
+            }
+        }
+        for (int i = 0; i < orig_num_v; i++) {
+            input->pointmtrlist[i] = num_edges[i] ? input->pointmtrlist[i] / num_edges[i] : 0;
+        }
+        for (int c = 0; c < 8; c++) {
+            input->pointmtrlist[orig_num_v + c] = options.far_field_size * (largest_extent + 2 * margin);
+        }
+        switches_string = "pYqAmQ";
+    }
 
-    tetgenio inner_output;
-    tetgenio outer_output;
-    tetgenbehavior switches;
-    switches.parse_commandline("pYqQ");
-    tetrahedralize(&switches, inner_input, &inner_output);
-    tetrahedralize(&switches, outer_input, &outer_output);
+    // the arrays below become the mesh's own storage; each tetgen array is freed as soon as it
+    // has been copied out, so the peak stays near one copy of the final mesh
+    std::vector<coord_t> vertices;
+    std::vector<unsigned int> tetrahedra;
+    std::vector<int> regions;
+    unsigned long long cache_key = options.use_cache ? MeshCache::get_key(*input, switches_string) : 0;
+    if (!options.use_cache || !MeshCache::load(cache_key, vertices, tetrahedra, regions)) {
+        // tetgen stops on a self-intersecting surface by throwing, and 1.5.0 frees its mesh
+        // twice on the way out, so the surface is screened first
+        int num_intersecting;
+        {
+            TRACE_SCOPE("check_surface");
+            num_intersecting = ifs.count_self_intersections();
+        }
+        if (num_intersecting > 0) {
+            printf("error: the surface intersects itself (%d pairs of faces cross), tetgen can't mesh it\n",
+                   num_intersecting);
+            delete input;
+            return NULL;
+        }
 
-    int outer_num_v = outer_output.numberofpoints - orig_num_v;
-    int inner_num_v = inner_output.numberofpoints - orig_num_v;
+        tetgenio output;
+        tetgenbehavior switches;
+        switches.parse_commandline((char *) switches_string);
+        try {
+            TRACE_SCOPE("tetrahedralize");
+            tetrahedralize(&switches, input, &output);
+        } catch (int code) {
+            printf("error: tetgen could not mesh the surface: %s (%d)\n", get_tetgen_error(code), code);
+            delete input;
+            return NULL;
+        }
 
-    int num_v = orig_num_v + outer_num_v + inner_num_v;
-    std::vector<REAL> vertices;
-    std::vector<REAL> targets;
-    vertices.resize(num_v * 3);
-    targets.resize(num_v * 3);
-    
-    for (int i = 0; i < orig_num_v + inner_num_v; i++) {
-        vec_copy(&vertices[i * 3], &inner_output.pointlist[i * 3]);
+        // with p (and Y) tetgen keeps the input points first and in order, Steiner points follow
+        int num_t = output.numberoftetrahedra;
+        vertices.assign(output.pointlist, output.pointlist + output.numberofpoints * 3);
+        delete[] output.pointlist;
+        output.pointlist = NULL;
+        tetrahedra.assign(output.tetrahedronlist, output.tetrahedronlist + num_t * 4);
+        delete[] output.tetrahedronlist;
+        output.tetrahedronlist = NULL;
+
+        // A puts the region attribute last
+        int num_attributes = output.numberoftetrahedronattributes;
+        regions.assign(num_t, OUTER_REGION_ATTRIBUTE);
+        if (num_attributes > 0) {
+            for (int i = 0; i < num_t; i++) {
+                regions[i] = (int) output.tetrahedronattributelist[i * num_attributes + num_attributes - 1];
+            }
+        } else {
+            printf("warning: tetgen returned no region attributes, every tet is OUTSIDE\n");
+        }
+        if (options.use_cache) {
+            MeshCache::store(cache_key, vertices, tetrahedra, regions);
+        }
     }
-    for (int i = orig_num_v; i < orig_num_v + outer_num_v; i++) {
-        vec_copy(&vertices[(i + inner_num_v) * 3], &outer_output.pointlist[i * 3]);
+    delete input;
+
+    std::vector<element_info_t> statuses = label_regions(tetrahedra, regions);
+    std::vector<int>().swap(regions);
+
+    TetMesh * tet_mesh = new TetMesh(std::move(vertices), std::move(tetrahedra), std::move(statuses));
+    if (options.reorder) {
+        // tetgen's output order scatters stars through memory
+        TRACE_SCOPE("reorder");
+        tet_mesh->reorder();
     }
+    return tet_mesh;
+}
 
-    for (int i = 0; i < num_v * 3; i++) {
-        targets[i] = vertices[i];
+// Splits [0, n) into one contiguous range per thread and runs body(begin, end) on each
+static void parallel_for(unsigned int n, unsigned int num_threads,
+                         const std::function<void (unsigned int, unsigned int)> & body) {
+    num_threads = std::max(1u, std::min(num_threads, n));
+    if (num_threads == 1) {
+        body(0, n);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < num_threads; t++) {
+        unsigned int begin = (unsigned long long) n * t / num_threads;
+        unsigned int end = (unsigned long long) n * (t + 1) / num_threads;
+        workers.push_back(std::thread(body, begin, end));
+    }
+    for (unsigned int t = 0; t < num_threads; t++) {
+        workers[t].join();
     }
+}
 
-    int inner_num_t = inner_output.numberoftetrahedra;
-    int num_t = outer_output.numberoftetrahedra + inner_num_t;
-    std::vector<unsigned int> tetrahedra;
-    std::vector<status_t> statuses;
-    tetrahedra.resize(num_t * 4);
-    statuses.resize(num_t);
-    for (int i = 0; i < inner_num_t; i++) {
-        for (int j = 0; j < 4; j++) {
-            tetrahedra[i * 4 + j] = inner_output.tetrahedronlist[i * 4 + j];
+// Body-centered cubic lattice over n[0] x n[1] x n[2] cubes of side h: the cube corners come
+// first (x fastest), then one vertex at the center of every cube. Each pair of face-adjacent
+// centers forms four tets with the edges of their shared face; a face on the domain boundary
+// forms a pyramid with its one center, split into two tets, so the domain stays a box.
+struct Lattice {
+    unsigned int n[3];
+    REAL min[3];
+    REAL h;
+
+    unsigned int get_num_corners() const { return (n[0] + 1) * (n[1] + 1) * (n[2] + 1); }
+    unsigned int get_num_cells() const { return n[0] * n[1] * n[2]; }
+
+    unsigned int corner(const unsigned int * c) const { return (c[2] * (n[1] + 1) + c[1]) * (n[0] + 1) + c[0]; }
+    unsigned int center(const unsigned int * c) const { return get_num_corners() + (c[2] * n[1] + c[1]) * n[0] + c[0]; }
+
+    // Lattice coordinates of vertex v; returns true for cube centers
+    bool get_coordinates(unsigned int v, unsigned int * c) const {
+        bool is_center = v >= get_num_corners();
+        unsigned int size[3];
+        for (int k = 0; k < 3; k++) {
+            size[k] = is_center ? n[k] : n[k] + 1;
         }
-        statuses[i] = INSIDE;
+        if (is_center) {
+            v -= get_num_corners();
+        }
+        c[0] = v % size[0];
+        c[1] = v / size[0] % size[1];
+        c[2] = v / size[0] / size[1];
+        return is_center;
     }
 
-    for (int i = 0; i < outer_output.numberoftetrahedra; i++) {
-        for (int j = 0; j < 4; j++) {
-            tetrahedra[(i + inner_num_t) * 4 + j] = outer_output.tetrahedronlist[i * 4 + j];
-            if (outer_output.tetrahedronlist[i * 4 + j] >= orig_num_v) {
-                tetrahedra[(i + inner_num_t) * 4 + j] += inner_num_v;
+    void get_position(unsigned int v, REAL * position) const {
+        unsigned int c[3];
+        REAL offset = get_coordinates(v, c) ? 0.5 : 0;
+        for (int k = 0; k < 3; k++) {
+            position[k] = min[k] + (c[k] + offset) * h;
+        }
+    }
+
+    bool is_on_boundary(unsigned int v) const {
+        unsigned int c[3];
+        if (get_coordinates(v, c)) {
+            return false;
+        }
+        return c[0] == 0 || c[1] == 0 || c[2] == 0 || c[0] == n[0] || c[1] == n[1] || c[2] == n[2];
+    }
+
+    // Writes the up to 14 lattice edges' other ends of vertex v and returns how many there are
+    unsigned int get_neighbors(unsigned int v, unsigned int * neighbors) const {
+        unsigned int c[3];
+        bool is_center = get_coordinates(v, c);
+        unsigned int count = 0;
+        // same kind of vertex, one step along each axis
+        for (int a = 0; a < 3; a++) {
+            unsigned int limit = is_center ? n[a] - 1 : n[a];
+            unsigned int other[3] = { c[0], c[1], c[2] };
+            if (c[a] > 0) {
+                other[a] = c[a] - 1;
+                neighbors[count++] = is_center ? center(other) : corner(other);
+            }
+            if (c[a] < limit) {
+                other[a] = c[a] + 1;
+                neighbors[count++] = is_center ? center(other) : corner(other);
+            }
+        }
+        // the other kind, half a step along the diagonals
+        for (int d = 0; d < 8; d++) {
+            unsigned int other[3];
+            bool valid = true;
+            for (int a = 0; a < 3; a++) {
+                int step = (d >> a) & 1;
+                if (is_center) {
+                    other[a] = c[a] + step;
+                } else {
+                    valid = valid && (step ? c[a] < n[a] : c[a] > 0);
+                    other[a] = c[a] - 1 + step;
+                }
+            }
+            if (valid) {
+                neighbors[count++] = is_center ? corner(other) : center(other);
             }
         }
-        statuses[i + inner_num_t] = OUTSIDE;
+        return count;
     }
 
-    delete inner_input;
-    delete outer_input;
+    // Corner on the face of cell c perpendicular to axis a at lattice coordinate `level`,
+    // offset by db and dd along the face's two axes
+    unsigned int face_corner(const unsigned int * c, int a, unsigned int level, int db, int dd) const {
+        unsigned int other[3];
+        other[a] = level;
+        other[(a + 1) % 3] = c[(a + 1) % 3] + db;
+        other[(a + 2) % 3] = c[(a + 2) % 3] + dd;
+        return corner(other);
+    }
+
+    // Writes the tets owned by cell c (4 vertex indices each) and returns how many there are;
+    // with out NULL only counts. A cell owns the tets on its positive faces and its boundary faces.
+    unsigned int get_cell_tets(const unsigned int * c, unsigned int * out) const {
+        static const int square[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+        unsigned int count = 0;
+        unsigned int own_center = center(c);
+        for (int a = 0; a < 3; a++) {
+            unsigned int faces[2] = { c[a] + 1, c[a] };
+            for (int side = 0; side < 2; side++) {
+                bool has_neighbor = side == 0 ? c[a] + 1 < n[a] : c[a] > 0;
+                if (side == 1 && has_neighbor) {
+                    continue; // owned by the neighbor
+                }
+                unsigned int q[4];
+                for (int e = 0; e < 4; e++) {
+                    q[e] = face_corner(c, a, faces[side], square[e][0], square[e][1]);
+                }
+                if (has_neighbor) {
+                    unsigned int next[3] = { c[0], c[1], c[2] };
+                    next[a]++;
+                    for (int e = 0; e < 4; e++, count++) {
+                        if (out != NULL) {
+                            unsigned int tet[4] = { own_center, center(next), q[e], q[(e + 1) % 4] };
+                            std::copy(tet, tet + 4, out + count * 4);
+                        }
+                    }
+                } else {
+                    for (int e = 1; e < 3; e++, count++) {
+                        if (out != NULL) {
+                            unsigned int tet[4] = { own_center, q[0], q[e], q[e + 1] };
+                            std::copy(tet, tet + 4, out + count * 4);
+                        }
+                    }
+                }
+            }
+        }
+        return count;
+    }
+};
+
+// Six times the signed volume of a, b, c, d; positive when d is above a, b, c counterclockwise
+static REAL signed_volume(const REAL * a, const REAL * b, const REAL * c, const REAL * d) {
+    REAL ab[3], ac[3], ad[3], cross[3];
+    vec_subtract(ab, b, a);
+    vec_subtract(ac, c, a);
+    vec_subtract(ad, d, a);
+    vec_cross(cross, ab, ac);
+    return vec_dot(cross, ad);
+}
+
+// Sine of the smallest dihedral angle of a, b, c, d, or 0 if they are flat or inverted. A sine
+// near 0 catches both kinds of sliver, the flat ones and those with an angle near 180 degrees.
+// The dihedral at an edge has sine 6 V |edge| / (|n1| |n2|), n1 and n2 being the cross products
+// of the two faces that meet there.
+static REAL get_min_dihedral_sine(const REAL * a, const REAL * b, const REAL * c, const REAL * d) {
+    REAL six_volume = signed_volume(a, b, c, d);
+    if (six_volume <= 0) {
+        return 0;
+    }
+    const REAL * p[4] = { a, b, c, d };
+    REAL face_norms[4];
+    for (int i = 0; i < 4; i++) {
+        REAL u[3], v[3], normal[3];
+        vec_subtract(u, p[(i + 2) % 4], p[(i + 1) % 4]);
+        vec_subtract(v, p[(i + 3) % 4], p[(i + 1) % 4]);
+        vec_cross(normal, u, v);
+        face_norms[i] = vec_length(normal);
+    }
+    REAL min_sine = 1;
+    for (int i = 0; i < 4; i++) {
+        for (int j = i + 1; j < 4; j++) {
+            // the faces meeting at edge i-j are the ones opposite the other two vertices
+            int k = 0;
+            while (k == i || k == j) {
+                k++;
+            }
+            int l = 6 - i - j - k;
+            REAL edge[3];
+            vec_subtract(edge, p[j], p[i]);
+            min_sine = std::min(min_sine, six_volume * vec_length(edge) / (face_norms[k] * face_norms[l]));
+        }
+    }
+    return min_sine;
+}
 
-    std::vector<GeometrySet<unsigned int>> vertex_to_tet(num_v);
-    for (int i = 0; i < num_t; i++) {
-        for (int j = 0; j < 4; j++) {
-            vertex_to_tet[tetrahedra[i * 4 + j]].insert(i);
+TetMesh * TetMeshFactory::from_signed_distance(const signed_distance_t & distance, const REAL * min, const REAL * max,
+                                               const LatticeOptions & options) {
+    TRACE_SCOPE("lattice_build");
+    Lattice lattice;
+    lattice.h = options.cell_size;
+    double num_cells = 1;
+    for (int k = 0; k < 3; k++) {
+        lattice.min[k] = min[k];
+        lattice.n[k] = std::max(1, (int) ceil((max[k] - min[k]) / options.cell_size));
+        num_cells *= lattice.n[k];
+    }
+    // at most 18 tets per cell
+    if (num_cells * 18 >= std::numeric_limits<unsigned int>::max()) {
+        printf("error: a lattice of %.0f cells overflows the mesh's 32-bit indices\n", num_cells);
+        return NULL;
+    }
+    unsigned int num_threads = options.num_threads ? options.num_threads : std::max(1u, std::thread::hardware_concurrency());
+    unsigned int num_v = lattice.get_num_corners() + lattice.get_num_cells();
+
+    // distance at every lattice point
+    std::vector<REAL> distances(num_v);
+    parallel_for(num_v, num_threads, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int v = begin; v < end; v++) {
+            REAL position[3];
+            lattice.get_position(v, position);
+            distances[v] = distance(position);
+        }
+    });
+
+    // snap each vertex to the closest zero crossing on its edges, if close enough; the boundary
+    // stays put so the domain remains a box
+    std::vector<coord_t> vertices(num_v * 3);
+    std::vector<unsigned char> snapped(num_v, 0);
+    parallel_for(num_v, num_threads, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int v = begin; v < end; v++) {
+            REAL position[3];
+            lattice.get_position(v, position);
+            unsigned int neighbors[14];
+            unsigned int num_neighbors = lattice.get_neighbors(v, neighbors);
+            REAL best_t = options.snap_fraction;
+            int best = -1;
+            for (unsigned int i = 0; i < num_neighbors && !lattice.is_on_boundary(v); i++) {
+                REAL d_v = distances[v];
+                REAL d_w = distances[neighbors[i]];
+                if ((d_v < 0) != (d_w < 0) && d_v != 0) {
+                    REAL t = d_v / (d_v - d_w);
+                    if (t < best_t) {
+                        best_t = t;
+                        best = neighbors[i];
+                    }
+                }
+            }
+            if (best != -1) {
+                REAL other[3];
+                lattice.get_position(best, other);
+                for (int k = 0; k < 3; k++) {
+                    position[k] += best_t * (other[k] - position[k]);
+                }
+                snapped[v] = 1;
+            }
+            for (int k = 0; k < 3; k++) {
+                vertices[v * 3 + k] = position[k];
+            }
         }
+    });
+    std::vector<REAL>().swap(distances);
+
+    // tets, written straight to their final slots from per-layer offsets
+    std::vector<unsigned int> layer_offsets(lattice.n[2] + 1, 0);
+    parallel_for(lattice.n[2], num_threads, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int z = begin; z < end; z++) {
+            unsigned int count = 0;
+            for (unsigned int y = 0; y < lattice.n[1]; y++) {
+                for (unsigned int x = 0; x < lattice.n[0]; x++) {
+                    unsigned int c[3] = { x, y, z };
+                    count += lattice.get_cell_tets(c, NULL);
+                }
+            }
+            layer_offsets[z + 1] = count;
+        }
+    });
+    for (unsigned int z = 0; z < lattice.n[2]; z++) {
+        layer_offsets[z + 1] += layer_offsets[z];
     }
+    unsigned int num_t = layer_offsets[lattice.n[2]];
+    std::vector<unsigned int> tetrahedra((size_t) num_t * 4);
+    parallel_for(lattice.n[2], num_threads, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int z = begin; z < end; z++) {
+            unsigned int * out = &tetrahedra[(size_t) layer_offsets[z] * 4];
+            for (unsigned int y = 0; y < lattice.n[1]; y++) {
+                for (unsigned int x = 0; x < lattice.n[0]; x++) {
+                    unsigned int c[3] = { x, y, z };
+                    unsigned int count = lattice.get_cell_tets(c, out);
+                    // orient every tet the same way, judged on the unsnapped lattice
+                    for (unsigned int t = 0; t < count; t++, out += 4) {
+                        REAL p[4][3];
+                        for (int j = 0; j < 4; j++) {
+                            lattice.get_position(out[j], p[j]);
+                        }
+                        if (signed_volume(p[0], p[1], p[2], p[3]) < 0) {
+                            std::swap(out[2], out[3]);
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // snapping can flatten, invert or sliver a tet; undo the snaps of tets whose smallest
+    // dihedral falls under the threshold until none are left, which restores the lattice's own
+    // tets (60 and 90 degree dihedrals) wherever it has to
+    REAL min_sine = sin(options.min_dihedral_angle * PI / 180);
+    for (bool changed = true; changed;) {
+        std::vector<unsigned char> bad(num_t, 0);
+        parallel_for(num_t, num_threads, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int t = begin; t < end; t++) {
+                const unsigned int * tet = &tetrahedra[(size_t) t * 4];
+                if (!snapped[tet[0]] && !snapped[tet[1]] && !snapped[tet[2]] && !snapped[tet[3]]) {
+                    continue;
+                }
+                REAL p[4][3];
+                for (int j = 0; j < 4; j++) {
+                    vec_copy(p[j], &vertices[tet[j] * 3]);
+                }
+                bad[t] = get_min_dihedral_sine(p[0], p[1], p[2], p[3]) < min_sine;
+            }
+        });
+        changed = false;
+        for (unsigned int t = 0; t < num_t; t++) {
+            for (int j = 0; j < 4 && bad[t]; j++) {
+                unsigned int v = tetrahedra[(size_t) t * 4 + j];
+                if (snapped[v]) {
+                    REAL position[3];
+                    lattice.get_position(v, position);
+                    vec_copy(&vertices[v * 3], position);
+                    snapped[v] = 0;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // label by the sign at the centroid of the final tet
+    std::vector<element_info_t> statuses(num_t);
+    parallel_for(num_t, num_threads, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int t = begin; t < end; t++) {
+            REAL centroid[3] = { 0, 0, 0 };
+            for (int j = 0; j < 4; j++) {
+                const coord_t * p = &vertices[tetrahedra[(size_t) t * 4 + j] * 3];
+                for (int k = 0; k < 3; k++) {
+                    centroid[k] += p[k] / 4;
+                }
+            }
+            statuses[t] = distance(centroid) < 0 ? INSIDE : OUTSIDE;
+        }
+    });
 
-    return new TetMesh(vertices, targets, tetrahedra, statuses, vertex_to_tet);
+    TetMesh * tet_mesh = new TetMesh(std::move(vertices), std::move(tetrahedra), std::move(statuses));
+    if (options.reorder) {
+        TRACE_SCOPE("reorder");
+        tet_mesh->reorder();
+    }
+    return tet_mesh;
 }
 
 TetMesh * TetMeshFactory::create_debug_tetmesh() {
-    std::vector<REAL> vertices;
-    std::vector<REAL> targets;
+    std::vector<coord_t> vertices;
     std::vector<unsigned int> tetrahedra;
-    std::vector<status_t> statuses;
+    std::vector<element_info_t> statuses;
 
     vertices.push_back(-3); vertices.push_back(0); vertices.push_back(0);
     vertices.push_back(0); vertices.push_back(2); vertices.push_back(0);
@@ -154,8 +696,6 @@ TetMesh * TetMeshFactory::create_debug_tetmesh() {
     vertices.push_back(0); vertices.push_back(-1); vertices.push_back(1);
     vertices.push_back(3); vertices.push_back(0); vertices.push_back(0);
 
-    for (unsigned int i = 0; i < vertices.size(); i++) { targets.push_back(vertices[i]); }
-    targets[0] = 1.5;
 
     tetrahedra.push_back(0); tetrahedra.push_back(1); tetrahedra.push_back(2); tetrahedra.push_back(3);
     statuses.push_back(INSIDE);
@@ -163,20 +703,16 @@ TetMesh * TetMeshFactory::create_debug_tetmesh() {
     tetrahedra.push_back(4); tetrahedra.push_back(1); tetrahedra.push_back(2); tetrahedra.push_back(3);
     statuses.push_back(OUTSIDE);
 
-    std::vector<GeometrySet<unsigned int>> vertex_to_tet(vertices.size() / 3);
-    for (unsigned int i = 0; i < tetrahedra.size(); i++) {
-        vertex_to_tet[tetrahedra[i]].insert(i / 4);
-    }
-    
-    return new TetMesh(vertices, targets, tetrahedra, statuses, vertex_to_tet);
+    TetMesh * tet_mesh = new TetMesh(std::move(vertices), std::move(tetrahedra), std::move(statuses));
+    tet_mesh->vertex_targets[0] = 1.5;
+    return tet_mesh;
 }
 
 
 TetMesh * TetMeshFactory::create_big_debug_tetmesh() {
-    std::vector<REAL> vertices;
-    std::vector<REAL> targets;
+    std::vector<coord_t> vertices;
     std::vector<unsigned int> tetrahedra;
-    std::vector<status_t> statuses;
+    std::vector<element_info_t> statuses;
 
     vertices.push_back(-3); vertices.push_back(0); vertices.push_back(0);
     vertices.push_back(0); vertices.push_back(2); vertices.push_back(0);
@@ -193,8 +729,6 @@ TetMesh * TetMeshFactory::create_big_debug_tetmesh() {
     vertices.push_back(-4); vertices.push_back(-1); vertices.push_back(-1);
     vertices.push_back(-4); vertices.push_back(-1); vertices.push_back(1);
 
-    for (unsigned int i = 0; i < vertices.size(); i++) { targets.push_back(vertices[i]); }
-    targets[0] = 1.5;
 
     tetrahedra.push_back(0); tetrahedra.push_back(1); tetrahedra.push_back(2); tetrahedra.push_back(3);
     statuses.push_back(INSIDE);
@@ -240,20 +774,16 @@ TetMesh * TetMeshFactory::create_big_debug_tetmesh() {
     tetrahedra.push_back(0); tetrahedra.push_back(11); tetrahedra.push_back(12); tetrahedra.push_back(13);
     statuses.push_back(OUTSIDE);
 
-    std::vector<GeometrySet<unsigned int>> vertex_to_tet(vertices.size() / 3);
-    for (unsigned int i = 0; i < tetrahedra.size(); i++) {
-        vertex_to_tet[tetrahedra[i]].insert(i / 4);
-    }
-    
-    return new TetMesh(vertices, targets, tetrahedra, statuses, vertex_to_tet);
+    TetMesh * tet_mesh = new TetMesh(std::move(vertices), std::move(tetrahedra), std::move(statuses));
+    tet_mesh->vertex_targets[0] = 1.5;
+    return tet_mesh;
 }
 
 
 TetMesh * TetMeshFactory::create_collapsed_tetmesh() {
-    std::vector<REAL> vertices;
-    std::vector<REAL> targets;
+    std::vector<coord_t> vertices;
     std::vector<unsigned int> tetrahedra;
-    std::vector<status_t> statuses;
+    std::vector<element_info_t> statuses;
 
     vertices.push_back(5); vertices.push_back(5); vertices.push_back(5);
     vertices.push_back(-5); vertices.push_back(-5); vertices.push_back(-5);
@@ -264,7 +794,6 @@ TetMesh * TetMeshFactory::create_collapsed_tetmesh() {
     vertices.push_back(-5); vertices.push_back(5); vertices.push_back(5);
     // vertices.push_back(-5); vertices.push_back(5); vertices.push_back(-5);
 
-    for (unsigned int i = 0; i < vertices.size(); i++) { targets.push_back(vertices[i]); }
 
     tetrahedra.push_back(0); tetrahedra.push_back(1); tetrahedra.push_back(2); tetrahedra.push_back(3);
     statuses.push_back(OUTSIDE);
@@ -273,12 +802,7 @@ TetMesh * TetMeshFactory::create_collapsed_tetmesh() {
     tetrahedra.push_back(0); tetrahedra.push_back(1); tetrahedra.push_back(4); tetrahedra.push_back(2);
     statuses.push_back(OUTSIDE);
 
-    std::vector<GeometrySet<unsigned int>> vertex_to_tet(vertices.size() / 3);
-    for (unsigned int i = 0; i < tetrahedra.size(); i++) {
-        vertex_to_tet[tetrahedra[i]].insert(i / 4);
-    }
-    
-    TetMesh * tet_mesh = new TetMesh(vertices, targets, tetrahedra, statuses, vertex_to_tet);
+    TetMesh * tet_mesh = new TetMesh(std::move(vertices), std::move(tetrahedra), std::move(statuses));
     unsigned int a = tet_mesh->split_edge(Edge(0, 1));
     unsigned int b = tet_mesh->split_edge(Edge(0, a));
     tet_mesh->collapse_edge(Edge(a, b));
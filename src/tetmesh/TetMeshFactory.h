@@ -1,17 +1,84 @@
-
 #ifndef TET_MESH_FACTORY_H
 #define TET_MESH_FACTORY_H
 
+#include <functional>
+
 #include "tetmesh.h"
 
 #include "model/IndexedFaceSet.h"
 
+// How from_indexed_face_set builds the domain around the surface
+struct MeshingOptions {
+    MeshingOptions()
+        : weld_tolerance(1e-6), face_budget(0), max_decimation_error(0), domain_margin(1), grading(true), far_field_size(0.25), reorder(true),
+          use_cache(true) { }
+
+    // The surface is cleaned in place first (IndexedFaceSet::clean) with this tolerance, relative
+    // to its bounding box diagonal; 0 leaves it untouched
+    float weld_tolerance;
+    // Then decimated in place (IndexedFaceSet::decimate) down to face_budget faces, stopping early
+    // once the surface would move by more than max_decimation_error of its bounding box diagonal.
+    // Tet count follows surface resolution, so this trades accuracy for evolve time; 0 and 0
+    // (the default) keep every face.
+    int face_budget;
+    float max_decimation_error;
+
+    // The domain is the surface's bounding box grown on every side by this fraction of its
+    // largest extent; it has to leave room for everywhere the interface will evolve to, and
+    // must be positive
+    REAL domain_margin;
+    // Grade tet size from the local surface edge length up to far_field_size at the domain
+    // corners (tetgen's m switch), instead of meshing the whole domain uniformly
+    bool grading;
+    REAL far_field_size;   // fraction of the domain's largest side
+    // Reorder the result along a space-filling curve (TetMesh::reorder)
+    bool reorder;
+    // Look the tetgen result up in, and add it to, the on-disk MeshCache
+    bool use_cache;
+};
+
+// Signed distance to an implicit surface: negative inside, positive outside. It is called from
+// several threads at once, so it must not modify shared state.
+typedef std::function<REAL (const REAL * point)> signed_distance_t;
+
+// How from_signed_distance builds its lattice
+struct LatticeOptions {
+    LatticeOptions() : cell_size(0.1), snap_fraction(0.2), min_dihedral_angle(20), num_threads(0), reorder(true) { }
+
+    REAL cell_size;
+    // A vertex moves onto the zero crossing of one of its edges when the crossing is within this
+    // fraction of the edge from it; more fits the surface closer but flattens more tets
+    REAL snap_fraction;
+    // Snaps are undone around any tet whose smallest dihedral angle (degrees) they push below this
+    REAL min_dihedral_angle;
+    unsigned int num_threads;   // 0 for one per hardware thread
+    bool reorder;
+};
+
 class TetMeshFactory {
     public:
+        // Meshes the surface together with a box-shaped domain around it in one tetgen pass;
+        // tets enclosed by the surface are INSIDE, the rest OUTSIDE. Cleans ifs in place first.
+        // NULL, after printing why, if the options are invalid or tetgen fails (a
+        // self-intersecting surface, for one).
         static TetMesh * from_indexed_face_set(IndexedFaceSet & ifs);
+        static TetMesh * from_indexed_face_set(IndexedFaceSet & ifs, const MeshingOptions & options);
+        // Fills the box [min, max] (grown to whole cells) with a body-centered cubic lattice of
+        // tets, snaps vertices near the zero set of `distance` onto it and labels each tet by the
+        // sign at its centroid. Linear in the number of cells and needs no tetgen; NULL if the
+        // lattice would overflow 32-bit indices.
+        static TetMesh * from_signed_distance(const signed_distance_t & distance, const REAL * min, const REAL * max,
+                                              const LatticeOptions & options);
         static TetMesh * create_debug_tetmesh();
         static TetMesh * create_big_debug_tetmesh();
         static TetMesh * create_collapsed_tetmesh();
+
+        // Used by the single-argument from_indexed_face_set, and so by the Scenarios
+        static const MeshingOptions & get_default_options() { return default_options; }
+        static void set_default_options(const MeshingOptions & options) { default_options = options; }
+
+    private:
+        static MeshingOptions default_options;
 };
 
 #endif
@@ -2,31 +2,65 @@
 
 #include <string>
 #include <fstream>
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <utility>
 
+#include "util/Trace.h"
 #include "util/vec.h"
 
-// threshold for determining geometric equality
-#define EPSILON 0.00001
 
-#define absolute(a) ((a) < 0 ? -(a) : (a))
+TetMesh::TetMesh(std::vector<coord_t> && vertices, std::vector<unsigned int> && tets,
+                 std::vector<element_info_t> && tet_statuses)
+    : vertices(std::move(vertices)), vertex_targets(this->vertices),
+      tets(std::move(tets)), tet_info(std::move(tet_statuses)) {
+    stats_output = NULL;
+    hardware_counters_enabled = false;
+    evolve_in_progress = false;
 
-TetMesh::TetMesh(std::vector<REAL> vertices, std::vector<REAL> vertex_targets,
-                 std::vector<unsigned int> tets, std::vector<status_t> tet_statuses,
-                 std::vector<GeometrySet<unsigned int>> vertex_tet_map) {
-    this->vertices = vertices;
-    this->vertex_targets = vertex_targets;
-    this->tets = tets;
-    this->tet_statuses = tet_statuses;
-    this->vertex_tet_map = vertex_tet_map;
+    vertex_info.resize(this->vertices.size() / 3, STATIC);
+    rebuild_vertex_tet_map();
 
-    vertex_statuses.resize(vertices.size() / 3, STATIC);
-    vertex_gravestones.resize(vertices.size() / 3, ALIVE);
-    tet_gravestones.resize(tets.size() / 3, ALIVE);
-
-    for (unsigned int v = 0; v < vertices.size() / 3; v++) {
-        if (is_on_domain_boundary(v)) {
-            vertex_statuses[v] = STATIC_BOUNDARY;
+    // the domain boundary never moves, so the initial bounding box holds for the mesh's lifetime
+    REAL min[] = {
+        0, 0, 0
+    };
+    REAL max[] = {
+        0, 0, 0
+    };
+    for (unsigned int v = 0; v < this->vertices.size() / 3; v++) {
+        for (unsigned int k = 0; k < 3; k++) {
+            REAL x = this->vertices[v * 3 + k];
+            min[k] = v == 0 || x < min[k] ? x : min[k];
+            max[k] = v == 0 || x > max[k] ? x : max[k];
+        }
+    }
+    predicates.set_bounds(min, max, std::numeric_limits<coord_t>::epsilon());
+
+    // same answer as is_on_domain_boundary() for every vertex, but one pass over the tets: a
+    // face is on the boundary when no other tet in its first vertex's star has all three
+    for (unsigned int t = 0; t < this->tets.size() / 4; t++) {
+        const unsigned int * tet = &this->tets[t * 4];
+        for (unsigned int skip = 0; skip < 4; skip++) {
+            unsigned int face[3];
+            for (unsigned int j = 0, n = 0; j < 4; j++) {
+                if (j != skip) {
+                    face[n++] = tet[j];
+                }
+            }
+            const std::vector<unsigned int> & star = vertex_tet_map[face[0]].getItems();
+            bool shared = false;
+            for (unsigned int i = 0; i < star.size() && !shared; i++) {
+                const unsigned int * other = &this->tets[star[i] * 4];
+                shared = star[i] != t && std::find(other, other + 4, face[1]) != other + 4 &&
+                    std::find(other, other + 4, face[2]) != other + 4;
+            }
+            if (!shared) {
+                for (unsigned int j = 0; j < 3; j++) {
+                    vertex_info[face[j]] = STATIC_BOUNDARY;
+                }
+            }
         }
     }
 }
@@ -36,58 +70,347 @@ TetMesh::~TetMesh() {
 }
 
 void TetMesh::evolve() {
-    bool done = false;
-    while (!done) {
+    TRACE_SCOPE("evolve");
+    evolve_stats.reset();
+    // counters are per thread, so they are opened by whichever thread runs this evolve()
+    PerfCounters * perf_counters = NULL;
+#ifndef DSC_NO_STATS
+    if (hardware_counters_enabled) {
+        perf_counters = PerfCounters::create();
+    }
+#endif
+    while (!evolve_iteration(perf_counters)) { }
+    delete perf_counters;
+    finish_evolve();
+}
+
+bool TetMesh::evolve_step() {
+    if (!evolve_in_progress) {
+        evolve_stats.reset();
+        evolve_in_progress = true;
+    }
+    bool done = evolve_iteration(NULL);
+    if (done) {
+        finish_evolve();
+    }
+    return done;
+}
+
+bool TetMesh::evolve_iteration(PerfCounters * perf_counters) {
+    TRACE_SCOPE("evolve_iteration");
+    bool done;
+    {
+        TRACE_SCOPE("advect");
+        STATS_TIMER(evolve_stats, PHASE_ADVECT);
+        STATS_HARDWARE(evolve_stats, perf_counters, PHASE_ADVECT);
         done = advect();
+    }
+    {
+        TRACE_SCOPE("retesselate");
+        STATS_TIMER(evolve_stats, PHASE_RETESSELATE);
+        STATS_HARDWARE(evolve_stats, perf_counters, PHASE_RETESSELATE);
         retesselate();
-        int num_tets = 0;
-        for (auto it = tet_gravestones.begin(); it != tet_gravestones.end(); it++) {
-            if (*it == ALIVE) {
-                num_tets++;
-            }
-        }
-        printf("num tets %i\n", num_tets);
     }
+    STATS_COUNT(evolve_stats, COUNTER_ITERATIONS);
+
+    printf("num tets %u\n", get_num_tets());
+    return done;
+}
+
+void TetMesh::finish_evolve() {
+    evolve_in_progress = false;
     for (unsigned int i = 0; i < vertices.size() / 3; i++) {
-        if (vertex_statuses[i] == MOVING) {
-            vertex_statuses[i] = STATIC;
+        if (get_vertex_state(i) == MOVING) {
+            set_vertex_state(i, STATIC);
+        }
+    }
+
+    total_stats.add(evolve_stats);
+    if (stats_output != NULL) {
+        fprintf(stats_output, "%s\n", evolve_stats.to_json().c_str());
+        fflush(stats_output);
+    }
+}
+
+void TetMesh::clear_dirty() {
+    for (auto it = vertex_info.begin(); it != vertex_info.end(); it++) {
+        *it &= ~INFO_DIRTY;
+    }
+    for (auto it = tet_info.begin(); it != tet_info.end(); it++) {
+        *it &= ~INFO_DIRTY;
+    }
+}
+
+// Interleaves the low 21 bits of x with two zero bits after each
+static unsigned long long spread_bits(unsigned long long x) {
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8) & 0x100f00f00f00f00fULL;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2) & 0x1249249249249249ULL;
+    return x;
+}
+
+// 63-bit Morton key of a point quantized to a 2^21 grid over [min, min + extent]
+static unsigned long long morton_key(const REAL * point, const REAL * min, const REAL * extent) {
+    unsigned long long key = 0;
+    for (unsigned int k = 0; k < 3; k++) {
+        REAL t = extent[k] > 0 ? (point[k] - min[k]) / extent[k] : 0;
+        t = t < 0 ? 0 : (t > 1 ? 1 : t);
+        key |= spread_bits((unsigned long long) (t * 0x1fffff)) << k;
+    }
+    return key;
+}
+
+void TetMesh::compact() {
+    std::vector<unsigned int> vertex_order;
+    std::vector<unsigned int> tet_order;
+    for (unsigned int v = 0; v < vertices.size() / 3; v++) {
+        if (is_vertex_alive(v)) {
+            vertex_order.push_back(v);
+        }
+    }
+    for (unsigned int t = 0; t < tets.size() / 4; t++) {
+        if (is_tet_alive(t)) {
+            tet_order.push_back(t);
+        }
+    }
+    permute(vertex_order, tet_order);
+}
+
+void TetMesh::reorder() {
+    compact();
+    unsigned int num_vertices = vertices.size() / 3;
+    unsigned int num_tets = tets.size() / 4;
+    if (num_vertices == 0) {
+        return;
+    }
+
+    REAL min[3], max[3], extent[3], position[3];
+    get_position(min, 0);
+    get_position(max, 0);
+    for (unsigned int v = 1; v < num_vertices; v++) {
+        get_position(position, v);
+        for (unsigned int k = 0; k < 3; k++) {
+            min[k] = std::min(min[k], position[k]);
+            max[k] = std::max(max[k], position[k]);
+        }
+    }
+    vec_subtract(extent, max, min);
+
+    std::vector< std::pair<unsigned long long, unsigned int> > keys(num_vertices);
+    for (unsigned int v = 0; v < num_vertices; v++) {
+        get_position(position, v);
+        keys[v] = std::make_pair(morton_key(position, min, extent), v);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<unsigned int> vertex_order(num_vertices);
+    for (unsigned int v = 0; v < num_vertices; v++) {
+        vertex_order[v] = keys[v].second;
+    }
+
+    // tets by the key of their centroid, so a vertex's star lands near the vertex itself
+    keys.resize(num_tets);
+    for (unsigned int t = 0; t < num_tets; t++) {
+        REAL centroid[] = {
+            0, 0, 0
+        };
+        for (unsigned int j = 0; j < 4; j++) {
+            get_position(position, tets[t * 4 + j]);
+            vec_add(centroid, centroid, position);
+        }
+        vec_divide(centroid, centroid, 4);
+        keys[t] = std::make_pair(morton_key(centroid, min, extent), t);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<unsigned int> tet_order(num_tets);
+    for (unsigned int t = 0; t < num_tets; t++) {
+        tet_order[t] = keys[t].second;
+    }
+
+    permute(vertex_order, tet_order);
+}
+
+void TetMesh::permute(const std::vector<unsigned int> & vertex_order, const std::vector<unsigned int> & tet_order) {
+    std::vector<unsigned int> new_index(vertices.size() / 3, (unsigned int) -1);
+    std::vector<coord_t> new_vertices(vertex_order.size() * 3);
+    std::vector<coord_t> new_targets(vertex_order.size() * 3);
+    std::vector<element_info_t> new_vertex_info(vertex_order.size());
+    for (unsigned int i = 0; i < vertex_order.size(); i++) {
+        unsigned int v = vertex_order[i];
+        new_index[v] = i;
+        vec_copy(&new_vertices[i * 3], &vertices[v * 3]);
+        vec_copy(&new_targets[i * 3], &vertex_targets[v * 3]);
+        new_vertex_info[i] = vertex_info[v];
+    }
+
+    std::vector<unsigned int> new_tets(tet_order.size() * 4);
+    std::vector<element_info_t> new_tet_info(tet_order.size());
+    for (unsigned int i = 0; i < tet_order.size(); i++) {
+        unsigned int t = tet_order[i];
+        for (unsigned int j = 0; j < 4; j++) {
+            assert(new_index[tets[t * 4 + j]] != (unsigned int) -1);
+            new_tets[i * 4 + j] = new_index[tets[t * 4 + j]];
+        }
+        new_tet_info[i] = tet_info[t];
+    }
+
+    vertices.swap(new_vertices);
+    vertex_targets.swap(new_targets);
+    vertex_info.swap(new_vertex_info);
+    tets.swap(new_tets);
+    tet_info.swap(new_tet_info);
+    rebuild_vertex_tet_map();
+}
+
+// Each star lists its tets in increasing index order. Stars are sized exactly before they are
+// filled, so building the map never reallocates one.
+void TetMesh::rebuild_vertex_tet_map() {
+    std::vector<unsigned int> degrees(vertices.size() / 3, 0);
+    for (unsigned int t = 0; t < tets.size() / 4; t++) {
+        if (!is_tet_alive(t)) {
+            continue;
+        }
+        for (unsigned int j = 0; j < 4; j++) {
+            degrees[tets[t * 4 + j]]++;
+        }
+    }
+    std::vector< GeometrySet<unsigned int> > map(vertices.size() / 3);
+    for (unsigned int v = 0; v < map.size(); v++) {
+        map[v].reserve(degrees[v]);
+    }
+    for (unsigned int t = 0; t < tets.size() / 4; t++) {
+        if (!is_tet_alive(t)) {
+            continue;
+        }
+        for (unsigned int j = 0; j < 4; j++) {
+            map[tets[t * 4 + j]].insert(t);
+        }
+    }
+    vertex_tet_map.swap(map);
+}
+
+unsigned int TetMesh::get_num_tets() {
+    unsigned int num_tets = 0;
+    for (auto it = tet_info.begin(); it != tet_info.end(); it++) {
+        if (!(*it & INFO_DEAD)) {
+            num_tets++;
+        }
+    }
+    return num_tets;
+}
+
+size_t TetMesh::get_memory_usage() {
+    size_t bytes = sizeof(TetMesh);
+    bytes += vertices.capacity() * sizeof(coord_t);
+    bytes += vertex_targets.capacity() * sizeof(coord_t);
+    bytes += vertex_info.capacity() * sizeof(element_info_t);
+    bytes += tets.capacity() * sizeof(unsigned int);
+    bytes += tet_info.capacity() * sizeof(element_info_t);
+    bytes += vertex_tet_map.capacity() * sizeof(GeometrySet<unsigned int>);
+    for (auto it = vertex_tet_map.begin(); it != vertex_tet_map.end(); it++) {
+        bytes += it->capacity() * sizeof(unsigned int);
+    }
+    return bytes;
+}
+
+bool TetMesh::write_to_files(std::string file_prefix) {
+    std::ofstream node_file(file_prefix + ".node");
+    std::ofstream ele_file(file_prefix + ".ele");
+    if (!node_file || !ele_file) {
+        std::cout << "error: could not open " << file_prefix << ".node/.ele for writing" << std::endl;
+        return false;
+    }
+
+    // renumber so that dead vertices and tets are skipped
+    unsigned int num_vertices = vertices.size() / 3;
+    std::vector<int> new_index(num_vertices, -1);
+    int num_alive_vertices = 0;
+    for (unsigned int i = 0; i < num_vertices; i++) {
+        if (is_vertex_alive(i)) {
+            new_index[i] = num_alive_vertices++;
+        }
+    }
+    int num_alive_tets = 0;
+    for (unsigned int i = 0; i < tets.size() / 4; i++) {
+        if (is_tet_alive(i)) {
+            num_alive_tets++;
+        }
+    }
+
+    node_file.precision(17);
+    node_file << num_alive_vertices << "  3  0  0" << std::endl;
+    for (unsigned int i = 0; i < num_vertices; i++) {
+        if (new_index[i] == -1) {
+            continue;
         }
+        node_file << new_index[i] << "  " << vertices[i * 3] << "  "
+            << vertices[i * 3 + 1] << "  " << vertices[i * 3 + 2] << std::endl;
     }
+
+    ele_file << num_alive_tets << "  4  1" << std::endl;
+    int t = 0;
+    for (unsigned int i = 0; i < tets.size() / 4; i++) {
+        if (!is_tet_alive(i)) {
+            continue;
+        }
+        ele_file << t++;
+        for (unsigned int j = 0; j < 4; j++) {
+            ele_file << "  " << new_index[tets[i * 4 + j]];
+        }
+        ele_file << "  " << (int) get_tet_status(i) << std::endl;
+    }
+
+    return node_file.good() && ele_file.good();
 }
 
 // move vertices as far toward target as possible
 bool TetMesh::advect() {
-    static REAL velocity[] = {
+    REAL velocity[] = {
         0, 0, 0
     };
     unsigned int num_vertices_at_target = 0;
     unsigned int num_vertices = vertices.size() / 3;
     for (unsigned int i = 0; i < num_vertices; i++) {
-        if (vertex_gravestones[i] == DEAD || vertex_statuses[i] != MOVING) {
+        // dead vertices never carry MOVING, so one load answers both
+        if (get_vertex_state(i) != MOVING || !is_vertex_alive(i)) {
             num_vertices_at_target++;
             continue;
         }
         vec_subtract(velocity, &vertex_targets[i * 3], &vertices[i * 3]);
         REAL target_distance = vec_length(velocity);
+        // a vertex that reached its target was copied onto it
+        if (target_distance == 0) {
+            num_vertices_at_target++;
+            continue;
+        }
+        // normalize velocity
+        vec_divide(velocity, velocity, target_distance);
+        DistanceMovableInfo dminfo = get_distance_movable(i, velocity);
+        REAL distance = dminfo.distance;
+        // judged against the tet the vertex runs into: one it can't move into is flat for
+        // is_coplanar(), so retesselate() removes it and the vertex goes on next iteration
+        REAL tolerance = predicates.get_length_tolerance(distance == -1 ? 0 : get_longest_edge_length(dminfo.tet_index));
         // this vertex is already moved
-        if (target_distance < EPSILON) {
+        if (target_distance < tolerance) {
             num_vertices_at_target++;
         } else {
-            // normalize velocity
-            vec_divide(velocity, velocity, target_distance);
-            DistanceMovableInfo dminfo = get_distance_movable(i, velocity);
-            REAL distance = dminfo.distance;
             if (distance == -1) {
+                STATS_COUNT(evolve_stats, COUNTER_BLOCKED_VERTICES);
                 std::cout << "warning: vertex " << i << " is on edge of world, exitting to avoid an infinite loop" << std::endl;
                 // return true;
-            } else if (distance < EPSILON) { // Vertex can't move but wants to
+            } else if (distance < tolerance) { // Vertex can't move but wants to
+                STATS_COUNT(evolve_stats, COUNTER_BLOCKED_VERTICES);
                 std::cout << "warning: unable to move vertex " << i << ", exitting to avoid an infinite loop" << std::endl;
                 // return true;
             } else if (distance >= target_distance) { // Vertex can move to target
                 vec_copy(&vertices[i * 3], &vertex_targets[i * 3]);
+                vertex_info[i] |= INFO_DIRTY;
             } else {
                 vec_scale(velocity, velocity, distance);
                 vec_add(&vertices[i * 3], &vertices[i * 3], velocity);
+                vertex_info[i] |= INFO_DIRTY;
                 if (!is_coplanar(dminfo.tet_index)) {
                     std::cout << "warning: tet " << dminfo.tet_index << " should be coplanar" << std::endl;
                     // return true;
@@ -100,15 +423,17 @@ bool TetMesh::advect() {
 
 TetMesh::DistanceMovableInfo TetMesh::get_distance_movable(unsigned int vertex_index, REAL * velocity) {
     DistanceMovableInfo dminfo;
-    static REAL plane[] = {
+    REAL plane[] = {
         0, 0, 0, 0
     };
+    REAL position[3];
+    get_position(position, vertex_index);
     GeometrySet<unsigned int> t = vertex_tet_map[vertex_index];
     for (auto it = t.begin(); it != t.end(); it++) {
-        assert(tet_gravestones[*it] != DEAD);
+        assert(is_tet_alive(*it));
         Face f = get_opposite_face(*it, vertex_index);
         calculate_plane(plane, f);
-        REAL distance = intersect_plane(plane, &vertices[vertex_index * 3], velocity);
+        REAL distance = intersect_plane(plane, position, velocity);
         if (distance >= 0 && (distance < dminfo.distance || dminfo.distance == -1)) {
             dminfo.distance = distance;
             dminfo.tet_index = *it;
@@ -118,17 +443,22 @@ TetMesh::DistanceMovableInfo TetMesh::get_distance_movable(unsigned int vertex_i
     return dminfo;
 }
 
+// widens a stored position to double precision for the predicates
+void TetMesh::get_position(REAL * position, unsigned int vertex_index) {
+    vec_copy(position, &vertices[vertex_index * 3]);
+}
+
 void TetMesh::calculate_plane(REAL * plane, Face f) {
-    static REAL temp1[] = {
+    REAL temp1[] = {
         0, 0, 0
     };
-    static REAL temp2[] = {
+    REAL temp2[] = {
         0, 0, 0
     };
 
-    REAL * v1 = &vertices[f.getV1() * 3];
-    REAL * v2 = &vertices[f.getV2() * 3];
-    REAL * v3 = &vertices[f.getV3() * 3];
+    coord_t * v1 = &vertices[f.getV1() * 3];
+    coord_t * v2 = &vertices[f.getV2() * 3];
+    coord_t * v3 = &vertices[f.getV3() * 3];
     vec_subtract(temp1, v1, v3);
     vec_subtract(temp2, v2, v3);
     vec_cross(plane, temp1, temp2);
@@ -137,20 +467,37 @@ void TetMesh::calculate_plane(REAL * plane, Face f) {
 }
 
 REAL TetMesh::intersect_plane(REAL * plane, REAL * vertex, REAL * velocity) {
-    REAL denominator = vec_dot(velocity, plane);
-    // ray perpendicular to plane
-    if (absolute(denominator) < EPSILON) {
+    // ray parallel to plane
+    if (Predicates::is_parallel(velocity, plane)) {
         return -1;
     }
+    REAL denominator = vec_dot(velocity, plane);
     return - (vec_dot(vertex, plane) + plane[3]) / denominator;
 }
 
 void TetMesh::retesselate() {
-    unsigned int num_tets;
+    {
+        TRACE_SCOPE("split_pass");
+        STATS_TIMER(evolve_stats, PHASE_SPLIT_PASS);
+        split_boundary_edges();
+    }
+    {
+        TRACE_SCOPE("collapse_tet_pass");
+        STATS_TIMER(evolve_stats, PHASE_COLLAPSE_TET_PASS);
+        collapse_degenerate_tets();
+    }
+    {
+        TRACE_SCOPE("collapse_edge_pass");
+        STATS_TIMER(evolve_stats, PHASE_COLLAPSE_EDGE_PASS);
+        collapse_movable_edges();
+    }
+}
 
-    num_tets = tets.size() / 4;
+// split edges running from the interface straight to the domain boundary
+void TetMesh::split_boundary_edges() {
+    unsigned int num_tets = tets.size() / 4;
     for (unsigned int i = 0; i < num_tets; i++) {
-        if (tet_gravestones[i] == DEAD) {
+        if (!is_tet_alive(i)) {
             continue;
         }
 
@@ -164,10 +511,12 @@ void TetMesh::retesselate() {
             }
         }
     }
+}
 
-    num_tets = tets.size() / 4;
+void TetMesh::collapse_degenerate_tets() {
+    unsigned int num_tets = tets.size() / 4;
     for (unsigned int i = 0; i < num_tets; i++) {
-        if (tet_gravestones[i] == DEAD) {
+        if (!is_tet_alive(i)) {
             continue;
         }
 
@@ -175,10 +524,12 @@ void TetMesh::retesselate() {
             collapse_tet(i);
         }
     }
+}
 
-    num_tets = tets.size() / 4;
+void TetMesh::collapse_movable_edges() {
+    unsigned int num_tets = tets.size() / 4;
     for (unsigned int i = 0; i < num_tets; i++) {
-        if (tet_gravestones[i] == DEAD) {
+        if (!is_tet_alive(i)) {
             continue;
         }
 
@@ -195,38 +546,21 @@ void TetMesh::retesselate() {
 }
 
 bool TetMesh::is_coplanar(unsigned int tet_id) {
-    static REAL u[] = {
-        0, 0, 0
-    };
-    static REAL v[] = {
-        0, 0, 0
-    };
-    static REAL w[] = {
-        0, 0, 0
-    };
-    static REAL x[] = {
-        0, 0, 0
-    };
-
-    REAL * v1 = &vertices[tets[tet_id * 4] * 3];
-    REAL * v2 = &vertices[tets[tet_id * 4 + 1] * 3];
-    REAL * v3 = &vertices[tets[tet_id * 4 + 2] * 3];
-    REAL * v4 = &vertices[tets[tet_id * 4 + 3] * 3];
-    vec_subtract(u, v2, v1);
-    vec_subtract(v, v3, v2);
-    vec_subtract(w, v4, v3);
-    vec_cross(x, u, v);
-
-    return absolute(vec_dot(x, w)) < EPSILON;
+    REAL v[4][3];
+    for (unsigned int i = 0; i < 4; i++) {
+        get_position(v[i], tets[tet_id * 4 + i]);
+    }
+    return predicates.is_flat(v[0], v[1], v[2], v[3]);
 }
 
 void TetMesh::collapse_tet(unsigned int i) {
     GeometrySet<Edge> edges = get_edges_from_tet(i);
 
-    // vertex on vertex
+    REAL tolerance = predicates.get_length_tolerance(get_longest_edge_length(i));
+
+    // vertex on vertex; if the collapse is refused the tet is still there for the cases below
     Edge shortest_edge = shortest_edge_in_set(edges);
-    if (get_edge_length(shortest_edge) < EPSILON) {
-        collapse_edge(shortest_edge);
+    if (get_edge_length(shortest_edge) < tolerance && collapse_edge(shortest_edge) != -1) {
         // Edge opp_edge = get_opposite_edge(i, shortest_edge);
         // unsigned int c = split_edge(opp_edge);
         // collapse_edge(Edge(c, shortest_edge.getV1()));
@@ -238,7 +572,7 @@ void TetMesh::collapse_tet(unsigned int i) {
     Edge closest_edge(0, 0);
     REAL min_dist = -1;
     for (unsigned int j = 0; j < 4; j++) {
-        unsigned int vert = tets[i * 4];
+        unsigned int vert = tets[i * 4 + j];
         Face f = get_opposite_face(i, vert);
         GeometrySet<Edge> opp_edges = get_edges_from_face(f);
         for (auto it = opp_edges.begin(); it != opp_edges.end(); it++) {
@@ -250,12 +584,26 @@ void TetMesh::collapse_tet(unsigned int i) {
             }
         }
     }
-    if (min_dist < EPSILON) {
+    if (min_dist < tolerance) {
         unsigned int c = split_edge(closest_edge);
         collapse_edge(Edge(closest_v, c));
         return;
     }
 
+    // a static vertex the interface has run into: merging it into another corner removes the
+    // tet outright, where splitting would only halve the gap and leave the split vertices behind
+    // whenever the final collapse is refused
+    std::vector<Edge> by_length = edges.getItems();
+    std::sort(by_length.begin(), by_length.end(), [this](Edge a, Edge b) {
+        return get_edge_length(a) < get_edge_length(b);
+    });
+    for (unsigned int j = 0; j < by_length.size(); j++) {
+        if ((is_movable(by_length[j].getV1()) || is_movable(by_length[j].getV2())) &&
+            collapse_edge(by_length[j]) != -1) {
+            return;
+        }
+    }
+
     GeometrySet<Face> faces = get_faces_from_tet(i);
     Face f = largest_face_in_set(faces);
     unsigned int apex = get_opposite_vertex(i, f);
@@ -273,42 +621,25 @@ void TetMesh::collapse_tet(unsigned int i) {
     }
 }
 
+// a flat tet is a cap if its apex lies within the opposite face, rather than across an edge
 bool TetMesh::is_cap(Face f, unsigned int apex) {
-    static REAL u[] = {
-        0, 0, 0
-    };
-    static REAL v[] = {
-        0, 0, 0
-    };
-    static REAL w[] = {
-        0, 0, 0
-    };
-    static REAL x[] = {
-        0, 0, 0
-    };
-
-    REAL * apex_data = &vertices[apex * 3];
-    REAL * v1 = &vertices[f.getV1() * 3];
-    REAL * v2 = &vertices[f.getV2() * 3];
-    REAL * v3 = &vertices[f.getV3() * 3];
-    vec_subtract(u, apex_data, v1);
-    vec_subtract(v, v2, apex_data);
-    vec_subtract(w, v3, v2);
-    vec_cross(x, u, v);
-    vec_cross(u, v, w);
-
-    return vec_dot(x, u) < 0;
+    REAL v1[3], v2[3], v3[3], apex_position[3];
+    get_position(v1, f.getV1());
+    get_position(v2, f.getV2());
+    get_position(v3, f.getV3());
+    get_position(apex_position, apex);
+    return predicates.projects_inside(v1, v2, v3, apex_position);
 }
 
 status_t TetMesh::get_vertex_status(unsigned int vertex_index) {
-    if (vertex_statuses[vertex_index] == STATIC_BOUNDARY) {
+    if (get_vertex_state(vertex_index) == STATIC_BOUNDARY) {
         return DOMAIN_BOUNDARY;
     }
     bool all_inside = true;
     bool all_outside = true;
     GeometrySet<unsigned int> neighbor_tets = vertex_tet_map[vertex_index];
     for (auto it = neighbor_tets.begin(); it != neighbor_tets.end(); it++) {
-        if (tet_statuses[*it] == INSIDE) {
+        if (get_tet_status(*it) == INSIDE) {
             all_outside = false;
         } else {
             all_inside = false;
@@ -349,22 +680,23 @@ unsigned int TetMesh::split_edge(Edge edge) {
 
     for (auto it = split.begin(); it != split.end(); it++) {
         Edge opposite = get_opposite_edge(*it, edge);
-        insert_tet(c, v1, opposite.getV1(), opposite.getV2(), tet_statuses[*it]);
-        insert_tet(c, v2, opposite.getV1(), opposite.getV2(), tet_statuses[*it]);
+        insert_tet(c, v1, opposite.getV1(), opposite.getV2(), get_tet_status(*it));
+        insert_tet(c, v2, opposite.getV1(), opposite.getV2(), get_tet_status(*it));
         delete_tet(*it);
     }
 
+    STATS_COUNT(evolve_stats, COUNTER_SPLITS);
     return c;
 }
 
 bool TetMesh::is_movable(unsigned int v) {
-    return vertex_statuses[v] == STATIC && get_vertex_status(v) != INTERFACE;
+    return get_vertex_state(v) == STATIC && get_vertex_status(v) != INTERFACE;
 }
 
 // TODO: collapsing could possible invert a tet
 //      Use getDistanceMovable to make sure this does not happen
 int TetMesh::collapse_edge(Edge edge) {
-    static REAL velocity[] = {
+    REAL velocity[] = {
         0, 0, 0
     };
 
@@ -373,6 +705,7 @@ int TetMesh::collapse_edge(Edge edge) {
     if (!is_movable(v1) && !is_movable(v2)) {
         std::cout << "warning: unable to collapse edge " << v1 << ", " << v2
             << ".  May be in an infinite loop." << std::endl;
+        STATS_COUNT(evolve_stats, COUNTER_FAILED_COLLAPSES);
         return -1;
     }
     GeometrySet<unsigned int> deleted = vertex_tet_map[v1].intersectWith(vertex_tet_map[v2]);
@@ -383,12 +716,14 @@ int TetMesh::collapse_edge(Edge edge) {
     if (!is_movable(v1)) {
         vec_subtract(velocity, &vertices[v1 * 3], &vertices[v2 * 3]);
         if (get_distance_movable(v2, velocity).distance < vec_length(velocity)) {
+            STATS_COUNT(evolve_stats, COUNTER_FAILED_COLLAPSES);
             return -1;
         }
         c = insert_vertex(edge, v1);
     } else if (!is_movable(v2)) {
         vec_subtract(velocity, &vertices[v2 * 3], &vertices[v1 * 3]);
         if (get_distance_movable(v1, velocity).distance < vec_length(velocity)) {
+            STATS_COUNT(evolve_stats, COUNTER_FAILED_COLLAPSES);
             return -1;
         }
         c = insert_vertex(edge, v2);
@@ -396,11 +731,13 @@ int TetMesh::collapse_edge(Edge edge) {
         vec_subtract(velocity, &vertices[v1 * 3], &vertices[v2 * 3]);
         vec_divide(velocity, velocity, 2);
         if (get_distance_movable(v2, velocity).distance < vec_length(velocity)) {
+            STATS_COUNT(evolve_stats, COUNTER_FAILED_COLLAPSES);
             return -1;
         }
 
         vec_scale(velocity, velocity, -1);
         if (get_distance_movable(v1, velocity).distance < vec_length(velocity)) {
+            STATS_COUNT(evolve_stats, COUNTER_FAILED_COLLAPSES);
             return -1;
         }
         c = insert_vertex(edge);
@@ -418,9 +755,10 @@ int TetMesh::collapse_edge(Edge edge) {
     for (auto it = deleted.begin(); it != deleted.end(); it++) {
         delete_tet(*it);
     }
-    vertex_gravestones[v1] = DEAD;
-    vertex_gravestones[v2] = DEAD;
+    vertex_info[v1] = INFO_DEAD | INFO_DIRTY;
+    vertex_info[v2] = INFO_DEAD | INFO_DIRTY;
 
+    STATS_COUNT(evolve_stats, COUNTER_COLLAPSES);
     return c;
 }
 
@@ -430,14 +768,13 @@ unsigned int TetMesh::insert_vertex(Edge edge) {
 
     unsigned int c = vertices.size() / 3;
     vertices.resize((c + 1) * 3);
-    REAL * c_data = &vertices[c * 3];
+    coord_t * c_data = &vertices[c * 3];
     vec_add(c_data, &vertices[v1 * 3], &vertices[v2 * 3]);
     vec_divide(c_data, c_data, 2);
 
     vertex_targets.resize((c + 1) * 3);
 
-    vertex_gravestones.push_back(ALIVE);
-    vertex_statuses.push_back(STATIC);
+    vertex_info.push_back(STATIC | INFO_DIRTY);
     vertex_tet_map.push_back(GeometrySet<unsigned int>());
     return c;
 }
@@ -445,19 +782,19 @@ unsigned int TetMesh::insert_vertex(Edge edge) {
 unsigned int TetMesh::insert_vertex(Edge edge, unsigned int moving_vertex) {
     unsigned int c = insert_vertex(edge);
 
-    if (vertex_statuses[moving_vertex] != STATIC) {
+    if (get_vertex_state(moving_vertex) != STATIC) {
         vec_copy(&vertex_targets[c * 3], &vertex_targets[moving_vertex * 3]);
     } else {
         vec_copy(&vertex_targets[c * 3], &vertices[moving_vertex * 3]);
     }
     vec_copy(&vertices[c * 3], &vertices[moving_vertex * 3]);
 
-    vertex_statuses[c] = vertex_statuses[moving_vertex];
+    set_vertex_state(c, get_vertex_state(moving_vertex));
     return c;
 }
 
 void TetMesh::delete_tet(unsigned int t) {
-    tet_gravestones[t] = DEAD;
+    tet_info[t] |= INFO_DEAD | INFO_DIRTY;
     for (unsigned int i = 0; i < 4; i++) {
         vertex_tet_map[tets[t * 4 + i]].remove(t);
     }
@@ -473,8 +810,7 @@ unsigned int TetMesh::insert_tet(unsigned int v1, unsigned int v2, unsigned int
     vertex_tet_map[v2].insert(t);
     vertex_tet_map[v3].insert(t);
     vertex_tet_map[v4].insert(t);
-    tet_gravestones.push_back(ALIVE);
-    tet_statuses.push_back(status);
+    tet_info.push_back(status | INFO_DIRTY);
     return t;
 }
 
@@ -495,30 +831,43 @@ Face TetMesh::get_opposite_face(unsigned int tet_id, unsigned int vert_id) {
 }
 
 REAL TetMesh::get_edge_length(Edge edge) {
-    static REAL base[] = {
+    REAL base[] = {
         0, 0, 0
     };
-    REAL * v1 = &vertices[edge.getV1() * 3];
-    REAL * v2 = &vertices[edge.getV2() * 3];
+    coord_t * v1 = &vertices[edge.getV1() * 3];
+    coord_t * v2 = &vertices[edge.getV2() * 3];
     vec_subtract(base, v1, v2);
     return vec_length(base);
 }
 
+REAL TetMesh::get_longest_edge_length(unsigned int tet_id) {
+    REAL longest = 0;
+    REAL edge[3];
+    const unsigned int * tet = &tets[tet_id * 4];
+    for (unsigned int i = 0; i < 4; i++) {
+        for (unsigned int j = i + 1; j < 4; j++) {
+            vec_subtract(edge, &vertices[tet[i] * 3], &vertices[tet[j] * 3]);
+            longest = fmax(longest, vec_sqr_length(edge));
+        }
+    }
+    return sqrt(longest);
+}
+
 // Derived from: http://mathworld.wolfram.com/Point-LineDistance3-Dimensional.html
 REAL TetMesh::distance_between_point_and_edge(Edge edge, int vertex_index) {
-    static REAL cross[] = {
+    REAL cross[] = {
         0, 0, 0
     };
-    static REAL temp1[] = {
+    REAL temp1[] = {
         0, 0, 0
     };
-    static REAL temp2[] = {
+    REAL temp2[] = {
         0, 0, 0
     };
 
-    REAL * v0 = &vertices[vertex_index * 3];
-    REAL * v1 = &vertices[edge.getV1() * 3];
-    REAL * v2 = &vertices[edge.getV2() * 3];
+    coord_t * v0 = &vertices[vertex_index * 3];
+    coord_t * v1 = &vertices[edge.getV1() * 3];
+    coord_t * v2 = &vertices[edge.getV2() * 3];
     vec_subtract(temp1, v2, v1);
     vec_subtract(temp2, v1, v0);
     vec_cross(cross, temp1, temp2);
@@ -565,11 +914,11 @@ Face TetMesh::largest_face_in_set(GeometrySet<Face> set_of_faces) {
     assert(set_of_faces.size() > 0);
     std::vector<Face> faces = set_of_faces.getItems();
     int largestFaceIndex = 0;
-    static REAL base[] = {
+    REAL base[] = {
         0, 0, 0
     };
-    REAL * v1 = &vertices[faces[0].getV1() * 3];
-    REAL * v2 = &vertices[faces[0].getV2() * 3];
+    coord_t * v1 = &vertices[faces[0].getV1() * 3];
+    coord_t * v2 = &vertices[faces[0].getV2() * 3];
     vec_subtract(base, v1, v2);
     REAL b = vec_length(base);
     REAL h = distance_between_point_and_edge(Edge(faces[0].getV1(), faces[0].getV2()), faces[0].getV3());
@@ -645,10 +994,10 @@ bool TetMesh::is_on_domain_boundary(unsigned int v) {
 // Derived from the equation at the end of section 3.2 in the DSC paper
 // *** NOTE: This function is not yet complete, as it does not compute the volume of the tet.
 REAL TetMesh::get_tet_quality(int tet_id) {
-    REAL * v1 = &vertices[tets[tet_id * 4] * 3];
-    REAL * v2 = &vertices[tets[tet_id * 4 + 1] * 3];
-    REAL * v3 = &vertices[tets[tet_id * 4 + 2] * 3];
-    REAL * v4 = &vertices[tets[tet_id * 4 + 3] * 3];
+    coord_t * v1 = &vertices[tets[tet_id * 4] * 3];
+    coord_t * v2 = &vertices[tets[tet_id * 4 + 1] * 3];
+    coord_t * v3 = &vertices[tets[tet_id * 4 + 2] * 3];
+    coord_t * v4 = &vertices[tets[tet_id * 4 + 3] * 3];
     
     // Compute volume:
     REAL mat[3][3];
@@ -668,7 +1017,7 @@ REAL TetMesh::get_tet_quality(int tet_id) {
 
     // Compute rms of lengths of edges:
     REAL l_rms = 0;
-    static REAL edgedist[] = {
+    REAL edgedist[] = {
         0, 0, 0
     };
     vec_subtract(edgedist, v1, v2);
@@ -694,7 +1043,7 @@ void TetMesh::report_tet_quality() {
     REAL highest_quality = 0;
     REAL avg_quality = 0;
     for (size_t i = 0; i < tets.size() / 4; i++) {
-        if (tet_gravestones[i] == DEAD) { continue; }
+        if (!is_tet_alive(i)) { continue; }
         REAL quality = get_tet_quality(i);
         if (quality < lowest_quality) { lowest_quality = quality; }
         if (quality > highest_quality) { highest_quality = quality; }
@@ -1,13 +1,24 @@
 #ifndef TET_MESH_H
 #define TET_MESH_H
 
+#include "EvolveStats.h"
 #include "model/IndexedFaceSet.h"
 #include "util/geometry.h"
 #include "util/geometrySet.h"
+#include "util/Predicates.h"
 #include "tetgen.h"
 #include <string>
 #include <vector>
 
+// Storage precision of vertex positions and targets. Configuring with --float-coords stores
+// floats, halving coordinate memory and bandwidth; predicates and plane intersections are
+// evaluated in REAL (double) either way.
+#ifdef DSC_FLOAT_COORDS
+typedef float coord_t;
+#else
+typedef REAL coord_t;
+#endif
+
 typedef enum {
     INSIDE = 0,
     OUTSIDE = 1,
@@ -15,37 +26,83 @@ typedef enum {
     DOMAIN_BOUNDARY = 3
 } status_t;
 
-typedef enum {
-    ALIVE = 0,
-    DEAD = 1
-} gravestone_t;
-
 typedef enum {
     STATIC = 0,
     MOVING = 1,
     STATIC_BOUNDARY = 2
 } vertex_status_t;
 
+// Per-element metadata packed into one byte, so the alive check and the status come from the
+// same load: the low bits hold a tet's status_t or a vertex's vertex_status_t, then flags.
+typedef unsigned char element_info_t;
+
+#define INFO_STATUS_MASK 0x03
+#define INFO_DEAD        0x04 // deleted; the slot is kept so indices stay valid
+#define INFO_DIRTY       0x08 // created, moved or changed status since the last clear_dirty()
+
 class TetMeshFactory;
-class TetrahedralViewer;
+class LiveSimulation;
+class PrimitiveBench;
+class PerfCounters;
 
 class TetMesh {
     friend class TetMeshFactory;
-    friend class TetrahedralViewer;
+    friend class LiveSimulation;
+    friend class PrimitiveBench;
 
 public:
 
     void evolve();
+    // One advect and retesselate iteration of evolve(), for callers that want to look at the
+    // mesh in between (the live viewer). Returns true once the targets are reached, after doing
+    // what the end of evolve() does; the next call then starts a new evolve. Hardware counters
+    // are not sampled in this mode.
+    bool evolve_step();
 
-    void bind_attributes(Renderable & renderable);
+    // Writes the live part of the mesh as tetgen-style <prefix>.node and <prefix>.ele files;
+    // each tet carries its status as an attribute. Returns false if a file could not be opened.
+    bool write_to_files(std::string file_prefix);
 
     ~TetMesh();
 
-    std::vector<REAL> vertices;         // 3 REALs per vertex for x, y, z
-    std::vector<REAL> vertex_targets;   // 3 REALs per vertex for x, y, z
-    std::vector<vertex_status_t> vertex_statuses;
+    unsigned int get_num_tets(); // live tets only
+    size_t get_memory_usage();   // bytes held by the mesh arrays, including dead elements
+
+    // Drops dead vertices and tets and renumbers the rest, keeping their relative order.
+    // Invalidates any vertex or tet index held outside the mesh.
+    void compact();
+    // Compacts, then sorts vertices and tets along a Morton (Z-order) curve through the bounding
+    // box so that elements close in space are close in memory. Same invalidation as compact().
+    void reorder();
+
+    // Totals over every evolve() since construction or reset_stats()
+    const EvolveStats & get_stats() { return total_stats; }
+    // Only the most recent evolve() call
+    const EvolveStats & get_last_evolve_stats() { return evolve_stats; }
+    void reset_stats() { total_stats.reset(); evolve_stats.reset(); }
+    // When set, evolve() writes its EvolveStats as one JSON line to this file on return
+    void set_stats_output(FILE * file) { stats_output = file; }
+    // Samples hardware counters around advect and retesselate (Linux perf_event_open, see
+    // util/PerfCounters.h); off by default since opening them costs a few syscalls per evolve()
+    void set_hardware_counters(bool enabled) { hardware_counters_enabled = enabled; }
+
+    std::vector<coord_t> vertices;         // 3 coordinates per vertex for x, y, z
+    std::vector<coord_t> vertex_targets;   // 3 coordinates per vertex for x, y, z
 
     status_t get_vertex_status(unsigned int vertex_index);
+
+    bool is_vertex_alive(unsigned int v) { return !(vertex_info[v] & INFO_DEAD); }
+    bool is_tet_alive(unsigned int t) { return !(tet_info[t] & INFO_DEAD); }
+    vertex_status_t get_vertex_state(unsigned int v) {
+        return (vertex_status_t) (vertex_info[v] & INFO_STATUS_MASK);
+    }
+    void set_vertex_state(unsigned int v, vertex_status_t state) {
+        vertex_info[v] = (vertex_info[v] & ~INFO_STATUS_MASK) | state | INFO_DIRTY;
+    }
+    status_t get_tet_status(unsigned int t) { return (status_t) (tet_info[t] & INFO_STATUS_MASK); }
+    bool is_vertex_dirty(unsigned int v) { return vertex_info[v] & INFO_DIRTY; }
+    bool is_tet_dirty(unsigned int t) { return tet_info[t] & INFO_DIRTY; }
+    void clear_dirty();
     
     REAL get_tet_quality(int tet_id);
     void report_tet_quality();
@@ -53,16 +110,24 @@ public:
 private:
     
     std::vector<unsigned int> tets;              // 4 vertex indices per tet
-    std::vector<status_t> tet_statuses;
 
-    std::vector<gravestone_t> vertex_gravestones; // ALIVE or DEAD per vertex
-    std::vector<gravestone_t> tet_gravestones;    // ALIVE or DEAD per tet
+    std::vector<element_info_t> vertex_info;     // vertex_status_t and flags per vertex
+    std::vector<element_info_t> tet_info;        // status_t and flags per tet
 
     std::vector< GeometrySet<unsigned int> > vertex_tet_map; // Each vertex has a set of neighboring tets
 
-    TetMesh(std::vector<REAL> vertices, std::vector<REAL> vertex_targets,
-            std::vector<unsigned int> tets, std::vector<status_t> tet_statuses,
-            std::vector<GeometrySet<unsigned int>> vertex_tet_map);
+    Predicates predicates; // orientation tests and tolerances scaled to this mesh
+
+    EvolveStats evolve_stats;
+    EvolveStats total_stats;
+    FILE * stats_output;
+    bool hardware_counters_enabled;
+    bool evolve_in_progress; // evolve_step() has started an evolve that has not finished
+
+    // Adopts the arrays without copying them; tet_statuses holds one status_t per tet. Targets
+    // start at the vertex positions and the vertex-tet map is built here.
+    TetMesh(std::vector<coord_t> && vertices, std::vector<unsigned int> && tets,
+            std::vector<element_info_t> && tet_statuses);
 
     struct DistanceMovableInfo {
         DistanceMovableInfo() : distance(-1), tet_index(-1) { }
@@ -70,11 +135,20 @@ private:
         int tet_index;
     };
 
+    bool evolve_iteration(PerfCounters * perf_counters);
+    void finish_evolve();
     bool advect();
     void retesselate();
+    void split_boundary_edges();
+    void collapse_degenerate_tets();
+    void collapse_movable_edges();
     bool is_coplanar(unsigned int tet_id);
     void collapse_tet(unsigned int i);
     bool is_cap(Face f, unsigned int apex);
+    void get_position(REAL * position, unsigned int vertex_index);
+    // Keeps the listed vertices and tets (old indices, in their new order) and drops the rest
+    void permute(const std::vector<unsigned int> & vertex_order, const std::vector<unsigned int> & tet_order);
+    void rebuild_vertex_tet_map();
     void calculate_plane(REAL * plane, Face f);
     DistanceMovableInfo get_distance_movable(unsigned int vertex_index, REAL * velocity);
     REAL intersect_plane(REAL * plane, REAL * vertex, REAL * velocity);
@@ -87,6 +161,7 @@ private:
     bool is_movable(unsigned int v);
 
     REAL get_edge_length(Edge edge);
+    REAL get_longest_edge_length(unsigned int tet_id);
     REAL distance_between_point_and_edge(Edge edge, int vertex_index);
     Edge shortest_edge_in_set(GeometrySet<Edge> set_of_edges);
     Edge longest_edge_in_set(GeometrySet<Edge> set_of_edges);
@@ -0,0 +1,120 @@
+#include "PerfCounters.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+const char * PerfCounters::get_event_name(int event) {
+    static const char * names[] = {
+        "instructions", "cycles", "llc_misses", "branch_misses"
+    };
+    return names[event];
+}
+
+PerfCounters::PerfCounters() : leader(-1), num_open(0) {
+    for (int i = 0; i < NUM_HW_EVENTS; i++) {
+        fds[i] = -1;
+    }
+}
+
+void PerfCounters::get_difference(const PerfSample & start, const PerfSample & end, unsigned long long * values) {
+    unsigned long long enabled = end.time_enabled - start.time_enabled;
+    unsigned long long running = end.time_running - start.time_running;
+    double scale = running > 0 && running < enabled ? (double) enabled / running : 1.0;
+    for (int i = 0; i < NUM_HW_EVENTS; i++) {
+        // the raw totals only ever grow, but don't trust a misbehaving PMU with an unsigned wrap
+        unsigned long long count = end.values[i] > start.values[i] ? end.values[i] - start.values[i] : 0;
+        values[i] = (unsigned long long) (count * scale);
+    }
+}
+
+#ifdef __linux__
+
+static int open_event(unsigned long long config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd == -1; // the leader starts the whole group
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+PerfCounters * PerfCounters::create() {
+    static const unsigned long long configs[] = {
+        PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    PerfCounters * counters = new PerfCounters();
+    for (int i = 0; i < NUM_HW_EVENTS; i++) {
+        counters->fds[i] = open_event(configs[i], counters->leader);
+        if (counters->fds[i] == -1) {
+            if (i == HW_INSTRUCTIONS) {
+                static bool warned = false;
+                if (!warned) {
+                    fprintf(stderr, "perf_event_open failed (%s); hardware counters disabled\n", strerror(errno));
+                    warned = true;
+                }
+                delete counters;
+                return NULL;
+            }
+            continue;
+        }
+        if (counters->leader == -1) {
+            counters->leader = counters->fds[i];
+        }
+        counters->num_open++;
+    }
+    ioctl(counters->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(counters->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return counters;
+}
+
+PerfCounters::~PerfCounters() {
+    for (int i = 0; i < NUM_HW_EVENTS; i++) {
+        if (fds[i] != -1) {
+            close(fds[i]);
+        }
+    }
+}
+
+bool PerfCounters::read(PerfSample & sample) {
+    // nr, time_enabled, time_running, then one value per open event in opening order
+    unsigned long long buffer[3 + NUM_HW_EVENTS];
+    ssize_t size = (3 + num_open) * sizeof(unsigned long long);
+    if (::read(leader, buffer, size) != size) {
+        return false;
+    }
+    sample.time_enabled = buffer[1];
+    sample.time_running = buffer[2];
+    int slot = 0;
+    for (int i = 0; i < NUM_HW_EVENTS; i++) {
+        sample.values[i] = fds[i] == -1 ? 0 : buffer[3 + slot++];
+    }
+    return true;
+}
+
+#else
+
+PerfCounters * PerfCounters::create() {
+    return NULL;
+}
+
+PerfCounters::~PerfCounters() {
+}
+
+bool PerfCounters::read(PerfSample & sample) {
+    return false;
+}
+
+#endif
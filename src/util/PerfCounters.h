@@ -0,0 +1,46 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+// Hardware performance counters for the calling thread, read through Linux perf_event_open.
+// create() returns NULL where that is unavailable (other platforms, no PMU in a VM, or
+// kernel.perf_event_paranoid too strict), so callers treat the counters as optional.
+
+typedef enum {
+    HW_INSTRUCTIONS = 0,
+    HW_CYCLES,
+    HW_LLC_MISSES,
+    HW_BRANCH_MISSES,
+    NUM_HW_EVENTS
+} hw_event_t;
+
+// One reading of the counters: the raw totals since create(), and how long the group has been
+// enabled and how much of that it was actually counting (less when the kernel multiplexes)
+struct PerfSample {
+    unsigned long long values[NUM_HW_EVENTS];
+    unsigned long long time_enabled;
+    unsigned long long time_running;
+};
+
+class PerfCounters {
+    public:
+        static PerfCounters * create();
+        ~PerfCounters();
+
+        // Events this CPU does not support read zero
+        bool read(PerfSample & sample);
+        // The events counted between two samples, scaled up by the share of that interval the
+        // counters were multiplexed out. Scaling the difference rather than each total keeps it
+        // from going negative when the multiplexing ratio changes in between.
+        static void get_difference(const PerfSample & start, const PerfSample & end, unsigned long long * values);
+
+        static const char * get_event_name(int event);
+
+    private:
+        PerfCounters();
+
+        int fds[NUM_HW_EVENTS];  // -1 for events that could not be opened
+        int leader;              // group leader fd, read with PERF_FORMAT_GROUP
+        int num_open;
+};
+
+#endif
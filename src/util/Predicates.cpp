@@ -0,0 +1,128 @@
+#include "Predicates.h"
+
+#include <math.h>
+#include <mutex>
+
+#include "util/vec.h"
+
+#define absolute(a) ((a) < 0 ? -(a) : (a))
+
+// det / longest_edge^3 of a flat tet; a regular tet has ~0.71
+#define FLATNESS_TOLERANCE 1e-5
+// relative to the local length. A tet with a vertex this close to the opposite face has
+// det <= 2 * face area * height <= sqrt(3) / 2 * longest_edge^3 * RELATIVE_LENGTH_TOLERANCE, so it
+// must not exceed FLATNESS_TOLERANCE
+#define RELATIVE_LENGTH_TOLERANCE 1e-5
+// cosine of the angle between a ray and a plane it is treated as parallel to
+#define PARALLEL_TOLERANCE 1e-12
+
+// Error bound of the floating-point determinant computed from coordinate differences no larger
+// than the box extents (the constant is the usual one for orient3d static filters)
+#define STATIC_FILTER_CONSTANT 5.1107127829973299e-15
+// Shewchuk's o3derrboundA for double precision: (7 + 56 * epsilon) * epsilon, epsilon = 2^-53
+#define DYNAMIC_FILTER_CONSTANT 7.7715611723761027e-16
+
+static std::once_flag exact_arithmetic_initialized;
+
+// Shewchuk's adaptive stage (predicates.cxx), not declared in tetgen.h. Unlike ::orient3d it does
+// not consult the static filter that every tetrahedralize() call resets for its own input.
+REAL orient3dadapt(REAL * pa, REAL * pb, REAL * pc, REAL * pd, REAL permanent);
+
+// rounding errors tolerated, in units of the storage epsilon
+#define STORAGE_ULPS 8
+
+Predicates::Predicates() : static_filter(0), height_tolerance(0) {
+    // orient3dadapt needs the machine epsilon and error bounds; tetrahedralize() sets them too,
+    // always to the same values
+    std::call_once(exact_arithmetic_initialized, [] { exactinit(0, 0, 0, 1, 1, 1); });
+}
+
+void Predicates::set_bounds(const REAL * min, const REAL * max, REAL storage_epsilon) {
+    REAL extent[3];
+    vec_subtract(extent, max, min);
+    static_filter = STATIC_FILTER_CONSTANT * extent[0] * extent[1] * extent[2];
+
+    REAL max_coordinate = 0;
+    for (int k = 0; k < 3; k++) {
+        max_coordinate = fmax(max_coordinate, fmax(absolute(min[k]), absolute(max[k])));
+    }
+    height_tolerance = STORAGE_ULPS * storage_epsilon * max_coordinate;
+}
+
+REAL Predicates::get_length_tolerance(REAL local_length) const {
+    return fmax(RELATIVE_LENGTH_TOLERANCE * local_length, height_tolerance);
+}
+
+REAL Predicates::orient3d(const REAL * a, const REAL * b, const REAL * c, const REAL * d) const {
+    REAL adx = a[0] - d[0], ady = a[1] - d[1], adz = a[2] - d[2];
+    REAL bdx = b[0] - d[0], bdy = b[1] - d[1], bdz = b[2] - d[2];
+    REAL cdx = c[0] - d[0], cdy = c[1] - d[1], cdz = c[2] - d[2];
+
+    REAL bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+    REAL cdxady = cdx * ady, adxcdy = adx * cdy;
+    REAL adxbdy = adx * bdy, bdxady = bdx * ady;
+    REAL det = adz * (bdxcdy - cdxbdy) + bdz * (cdxady - adxcdy) + cdz * (adxbdy - bdxady);
+    if (absolute(det) > static_filter) {
+        return det;
+    }
+
+    REAL permanent = (absolute(bdxcdy) + absolute(cdxbdy)) * absolute(adz)
+                   + (absolute(cdxady) + absolute(adxcdy)) * absolute(bdz)
+                   + (absolute(adxbdy) + absolute(bdxady)) * absolute(cdz);
+    if (absolute(det) > DYNAMIC_FILTER_CONSTANT * permanent) {
+        return det;
+    }
+    return orient3dadapt((REAL *) a, (REAL *) b, (REAL *) c, (REAL *) d, permanent);
+}
+
+bool Predicates::is_flat(const REAL * a, const REAL * b, const REAL * c, const REAL * d) const {
+    REAL det = orient3d(a, b, c, d);
+    if (det == 0) {
+        return true;
+    }
+    const REAL * points[] = {
+        a, b, c, d
+    };
+    REAL longest = 0;
+    REAL edge[3];
+    for (int i = 0; i < 4; i++) {
+        for (int j = i + 1; j < 4; j++) {
+            vec_subtract(edge, points[i], points[j]);
+            REAL length = vec_sqr_length(edge);
+            longest = length > longest ? length : longest;
+        }
+    }
+    // |det| is about the longest edge squared times the height
+    return absolute(det) <= longest * fmax(FLATNESS_TOLERANCE * sqrt(longest), height_tolerance);
+}
+
+bool Predicates::projects_inside(const REAL * a, const REAL * b, const REAL * c, const REAL * p) const {
+    // p projects inside iff it is on the inner side of the plane through each edge that
+    // contains the triangle normal. Not exact: callers have already ruled out p projecting
+    // onto an edge, so the sign is only needed away from zero.
+    REAL u[3], v[3], normal[3];
+    vec_subtract(u, b, a);
+    vec_subtract(v, c, a);
+    vec_cross(normal, u, v);
+
+    const REAL * corners[] = {
+        a, b, c
+    };
+    REAL edge[3], inward[3], offset[3];
+    for (int i = 0; i < 3; i++) {
+        const REAL * from = corners[i];
+        const REAL * to = corners[(i + 1) % 3];
+        vec_subtract(edge, to, from);
+        vec_cross(inward, normal, edge);
+        vec_subtract(offset, p, from);
+        if (vec_dot(inward, offset) <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Predicates::is_parallel(const REAL * direction, const REAL * normal) {
+    REAL dot = vec_dot(direction, normal);
+    return absolute(dot) <= PARALLEL_TOLERANCE * vec_length(normal);
+}
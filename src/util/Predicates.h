@@ -0,0 +1,51 @@
+#ifndef PREDICATES_H
+#define PREDICATES_H
+
+#include "tetgen.h"
+
+// Geometric predicates and tolerances for one mesh. orient3d() answers from a static error
+// bound derived from the mesh's bounding box when it can, then from Shewchuk's dynamic bound,
+// and only falls back to his adaptive exact stage (orient3dadapt in tetgen's predicates.cxx) for
+// the rare near-degenerate cases, so its sign is always correct. None of this depends on the
+// static filter tetgen keeps for its own meshing.
+//
+// Tolerances scale with the elements they judge: lengths are relative to a local length, such as
+// the longest edge of the tet involved, and volumes to the cube of the tet's longest edge, so the
+// same decisions are made at any model scale and in any size of domain. Neither drops below what
+// the storage precision of the coordinates can resolve.
+
+class Predicates {
+    public:
+        Predicates();
+
+        // Every point passed to orient3d() must lie in this box. storage_epsilon is the machine
+        // epsilon of the stored coordinates, which bounds how close to zero lengths can get.
+        void set_bounds(const REAL * min, const REAL * max, REAL storage_epsilon);
+
+        // Positive if d lies below the plane through a, b, c (which appear counterclockwise
+        // seen from above), negative if above, exactly zero if coplanar. The magnitude is six
+        // times the tet volume, approximate only when the fallback was needed.
+        REAL orient3d(const REAL * a, const REAL * b, const REAL * c, const REAL * d) const;
+
+        // Distances below this are treated as zero next to elements of about local_length. A
+        // vertex within it of a face of a tet whose longest edge is local_length makes that tet
+        // flat for is_flat(), so whatever stops at this distance is then removed as flat.
+        REAL get_length_tolerance(REAL local_length) const;
+
+        // True if the tet a, b, c, d is exactly flat or its height is a negligible fraction of
+        // its longest edge
+        bool is_flat(const REAL * a, const REAL * b, const REAL * c, const REAL * d) const;
+
+        // True if the projection of p onto the plane of triangle a, b, c lies strictly inside it
+        // (floating point; only meaningful when p is not about to project onto an edge)
+        bool projects_inside(const REAL * a, const REAL * b, const REAL * c, const REAL * p) const;
+
+        // True if direction (unit length) is parallel to a plane with the given unnormalized normal
+        static bool is_parallel(const REAL * direction, const REAL * normal);
+
+    private:
+        REAL static_filter;     // |det| above this has the right sign for any points in the box
+        REAL height_tolerance;  // rounding error of a stored coordinate, in absolute length
+};
+
+#endif
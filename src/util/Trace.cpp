@@ -0,0 +1,123 @@
+#include "Trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#define EVENTS_PER_CHUNK 4096
+
+struct TraceEvent {
+    const char * name;
+    char phase;      // 'B' or 'E'
+    double time_us;  // since the trace started
+};
+
+// Events are appended only by the owning thread. `count` is published with release
+// semantics so the writer sees complete events; chunks are never moved or freed.
+struct TraceChunk {
+    TraceChunk() : count(0), next(NULL) { }
+    TraceEvent events[EVENTS_PER_CHUNK];
+    std::atomic<unsigned int> count;
+    std::atomic<TraceChunk *> next;
+};
+
+struct ThreadBuffer {
+    ThreadBuffer(int thread_id) : thread_id(thread_id), head(new TraceChunk()), tail(head) { }
+    int thread_id;
+    TraceChunk * head;
+    TraceChunk * tail;
+};
+
+bool Trace::enabled = false;
+
+static std::string trace_file;
+static std::chrono::steady_clock::time_point trace_start;
+static std::mutex buffers_mutex; // only taken when a thread records its first event, and by write()
+static std::vector<ThreadBuffer *> buffers;
+static thread_local ThreadBuffer * thread_buffer = NULL;
+
+static void write_at_exit() {
+    Trace::write();
+}
+
+static bool start_from_environment() {
+    const char * file_name = getenv("IDSC_TRACE");
+    if (file_name != NULL && file_name[0] != '\0') {
+        Trace::start(file_name);
+    }
+    return true;
+}
+
+static bool started_from_environment = start_from_environment();
+
+void Trace::start(std::string file_name) {
+    if (enabled) {
+        return;
+    }
+    trace_file = file_name;
+    trace_start = std::chrono::steady_clock::now();
+    enabled = true;
+    atexit(write_at_exit);
+}
+
+static void record(const char * name, char phase) {
+    double time_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - trace_start).count();
+    if (thread_buffer == NULL) {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        thread_buffer = new ThreadBuffer(buffers.size() + 1);
+        buffers.push_back(thread_buffer);
+    }
+
+    TraceChunk * chunk = thread_buffer->tail;
+    unsigned int i = chunk->count.load(std::memory_order_relaxed);
+    if (i == EVENTS_PER_CHUNK) {
+        TraceChunk * next = new TraceChunk();
+        chunk->next.store(next, std::memory_order_release);
+        thread_buffer->tail = next;
+        chunk = next;
+        i = 0;
+    }
+    chunk->events[i].name = name;
+    chunk->events[i].phase = phase;
+    chunk->events[i].time_us = time_us;
+    chunk->count.store(i + 1, std::memory_order_release);
+}
+
+void Trace::begin(const char * name) {
+    record(name, 'B');
+}
+
+void Trace::end(const char * name) {
+    record(name, 'E');
+}
+
+void Trace::write() {
+    if (!enabled) {
+        return;
+    }
+    FILE * file = fopen(trace_file.c_str(), "w");
+    if (file == NULL) {
+        fprintf(stderr, "could not write trace file %s\n", trace_file.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    for (unsigned int b = 0; b < buffers.size(); b++) {
+        for (TraceChunk * chunk = buffers[b]->head; chunk != NULL; chunk = chunk->next.load(std::memory_order_acquire)) {
+            unsigned int count = chunk->count.load(std::memory_order_acquire);
+            for (unsigned int i = 0; i < count; i++) {
+                TraceEvent & e = chunk->events[i];
+                fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %d}",
+                        first ? "" : ",\n", e.name, e.phase, e.time_us, buffers[b]->thread_id);
+                first = false;
+            }
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+}
@@ -0,0 +1,45 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+
+// Optional timeline tracer. Once started (Trace::start, or the IDSC_TRACE=<file> environment
+// variable), TRACE_SCOPE records begin/end events into a buffer owned by the calling thread,
+// without locking, and the whole timeline is written as Chrome trace-event JSON at exit
+// (open it in chrome://tracing or ui.perfetto.dev). When not started a scope costs one branch.
+//
+// Event names must be string literals: only the pointer is stored.
+
+class Trace {
+    public:
+        static void start(std::string file_name);
+        static bool is_enabled() { return enabled; }
+        static void begin(const char * name);
+        static void end(const char * name);
+        // Writes everything recorded so far; runs automatically at exit once started
+        static void write();
+    private:
+        static bool enabled;
+};
+
+class TraceScope {
+    public:
+        TraceScope(const char * name) : name(name) {
+            if (Trace::is_enabled()) {
+                Trace::begin(name);
+            }
+        }
+        ~TraceScope() {
+            if (Trace::is_enabled()) {
+                Trace::end(name);
+            }
+        }
+    private:
+        const char * name;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif
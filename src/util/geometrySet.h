@@ -124,6 +124,20 @@ public:
         return items.size();
     }
 
+    /**
+     * Returns the number of items the set can hold without reallocating
+     */
+    unsigned int capacity() const {
+        return items.capacity();
+    }
+
+    /**
+     * Makes room for n items without reallocating
+     */
+    void reserve(size_t n) {
+        items.reserve(n);
+    }
+
     /**
      * Returns true if the given item is in the set, false otherwise
      */